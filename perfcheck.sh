@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Script to compile the sudoku program with optimization and compare its
+# benchmarks with the recorded baselines for this machine and build.
+# Exits with 1 if any benchmark got significantly slower or has no
+# baseline for this machine and build.
+#
+#   ./perfcheck.sh           compare with perf-baseline.txt
+#   ./perfcheck.sh --record  (re)record the baselines for this machine
+#
+# A baseline is the means of RUNS separate runs, so that it reflects how
+# much whole runs differ, not only the samples inside one run.
+BASELINE=perf-baseline.txt
+RUNS=10
+if [ "$1" == "--record" ]; then
+  RECORD=1
+elif [ ! -r $BASELINE ]; then
+  echo "No baselines in $BASELINE; run ./perfcheck.sh --record first"
+  exit 1
+fi
+rm -f sudoku
+gcc -O2 -Wall -Wextra -pthread -std=c99 sudoku.c -o sudoku -lm || exit 1
+
+MODES=("--microbench 36" "--bench-scaling 4 36" "--bench-startup 200 9")
+NAMES=(microbench bench-scaling bench-startup)
+status=0
+if [ -n "$RECORD" ]; then
+  # Round-robin over the modes, so each mode's runs are spread over the
+  # whole recording and see more of the host's drift
+  for i in $(seq 1 $RUNS); do
+    for m in "${!MODES[@]}"; do
+      [ $i == 1 ] && save=--save || save=--add
+      ./sudoku ${MODES[$m]} $save $BASELINE > /dev/null || status=1
+    done
+  done
+  echo "Recorded $RUNS runs of each benchmark mode in $BASELINE"
+  exit $status
+fi
+for m in "${!MODES[@]}"; do
+  ./sudoku ${MODES[$m]} --compare $BASELINE || status=1
+  echo "________________________________${NAMES[$m]}"
+done
+exit $status
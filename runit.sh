@@ -2,7 +2,7 @@
 
 # Script to compile and run sudoku program
 rm -f sudoku
-gcc -Wall -Wextra -pthread -lm -std=c99 sudoku.c -o sudoku
+gcc -Wall -Wextra -pthread -std=c99 sudoku.c -o sudoku -lm
 ./sudoku puzzle2-fill-valid.txt
 echo "________________________________puzzle2-fill-valid.txt"
 ./sudoku puzzle2-invalid.txt
@@ -21,6 +21,78 @@ echo "________________________________puzzle9-simple-solve.txt"
 echo "________________________________puzzle9-unsolvable.txt"
 ./sudoku puzzle9-valid.txt
 echo "________________________________puzzle9-valid.txt"
+./sudoku puzzle16-valid.txt
+echo "________________________________puzzle16-valid.txt"
+./sudoku --engine fill puzzle9-simple-solve.txt
+echo "________________________________fill puzzle9-simple-solve.txt"
+./sudoku puzzle36-fill-valid.txt
+echo "________________________________puzzle36-fill-valid.txt"
+./sudoku --profile tune-one-thread.txt puzzle36-fill-valid.txt
+echo "________________________________profile puzzle36-fill-valid.txt"
+./sudoku --profile missing-profile.txt puzzle4-solvable.txt
+echo "________________________________missing profile"
+./sudoku --engine search puzzle9-unsolvable.txt
+echo "________________________________search puzzle9-unsolvable.txt"
+./sudoku --engine search --stats puzzle4-solvable.txt
+echo "________________________________search puzzle4-solvable.txt"
+./sudoku --engine search --stats puzzle9-many-solutions.txt
+echo "________________________________search puzzle9-many-solutions.txt"
+./sudoku --engine search --stats --mem-budget 128K --profile tune-one-thread.txt puzzle25-search.txt
+echo "________________________________search --mem-budget puzzle25-search.txt"
+./sudoku --engine template puzzle9-simple-solve.txt
+echo "________________________________template puzzle9-simple-solve.txt"
+./sudoku --engine template puzzle9-unsolvable.txt
+echo "________________________________template puzzle9-unsolvable.txt"
+./sudoku --train-selector selector-log-small.txt --model selector-test.txt
+cat selector-test.txt
+./sudoku --engine auto --model selector-test.txt puzzle9-simple-solve.txt
+./sudoku --engine auto --model selector-test.txt puzzle9-unsolvable.txt
+./sudoku --bench-engines corpus-small.txt --model selector-test.txt | head -1
+./sudoku --async --workers 2 --engine auto --model selector-test.txt puzzle9-simple-solve.txt
+echo 'interactive puzzle9-simple-solve.txt' | ./sudoku --serve --workers 2 --engine auto --model selector-test.txt
+rm selector-test.txt
+echo "________________________________selector"
+./sudoku --audit audit-logs.txt 2
+echo "________________________________audit-logs.txt"
+./sudoku --corpus-index corpus-small.txt 2
+./sudoku --corpus-get corpus-small.txt 1
+./sudoku --corpus-sample corpus-small.txt 2 --size 9 --clues 60- --seed 3
+rm -f corpus-small.txt.idx
+echo "________________________________corpus-small.txt"
+./sudoku --sample-solutions puzzle9-many-solutions.txt 2 --threads 2 --seed 3
+echo "________________________________puzzle9-many-solutions.txt"
+./sudoku --augment puzzle9-valid.txt 5000 augmented.bin --threads 2 --seed 7
+./sudoku --boards-print augmented.bin 4998 2
+rm -f augmented.bin
+echo "________________________________augmented.bin"
+./sudoku --export-tensors puzzle9-unsolvable.txt puzzle9.tensors --bits --threads 2
+wc -c < puzzle9.tensors
+rm -f puzzle9.tensors
+echo "________________________________puzzle9.tensors"
+./sudoku --repair puzzle4-complete-invalid.txt --threads 2
+./sudoku --repair puzzle2-invalid.txt --threads 1
+echo "________________________________repair"
+./sudoku --augment puzzle9-many-solutions.txt 2 dedup.bin --seed 5 > /dev/null
+(cat corpus-small.txt; ./sudoku --boards-print dedup.bin 0 2) > dedup.txt
+./sudoku --dedup dedup.txt 2
+rm -f dedup.bin dedup.txt
+echo "________________________________dedup"
+./sudoku --async --workers 3 --engine search puzzle9-simple-solve.txt puzzle4-complete-invalid.txt puzzle16-valid.txt
+echo "________________________________async"
+printf 'interactive puzzle9-simple-solve.txt\nbulk puzzle16-valid.txt\ninteractive missing.txt\ninteractive puzzle4-complete-invalid.txt\n' | ./sudoku --serve --workers 2 --bulk-queue 0 | LC_ALL=C sort
+echo "________________________________serve"
+./sudoku --trace puzzle2-fill-valid.txt walk.trace
+./sudoku --replay walk.trace
+./sudoku --replay walk.trace 2
+./sudoku --trace puzzle9-many-solutions.txt guess.trace
+./sudoku --replay guess.trace | grep -m2 -A1 guesses
+rm walk.trace guess.trace
+echo "________________________________trace"
+./sudoku --engine search --capture-slow 0.001 --capture-dir capture-test puzzle9-simple-solve.txt > /dev/null
+grep -v _ms capture-test/slot-00.txt
+./sudoku --bench-replay capture-test 2 | awk '{print $1, $2, $3}'
+rm -r capture-test
+echo "________________________________capture-slow"
 
 
 # to check for memory leaks, use
@@ -1,11 +1,38 @@
 // Sudoku puzzle verifier and solver
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <math.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 // Structure for passing data to threads
 typedef struct {
@@ -15,12 +42,53 @@ typedef struct {
   int *result_arr;  // Shared array for results
   int *filled_count; // Shared counter for filled zeros
   pthread_mutex_t *lock; // Mutex for the shared counter
+  int num_threads;  // Threads sharing the units (check_units/solve_units)
 } parameters;
 
+// Unit kinds for the 9x9 validators
+enum { UNIT_ROW, UNIT_COL, UNIT_BOX };
+
+// From this size on checkPuzzle fills in by bands (see fillPuzzleBands)
+#define BAND_MIN_PSIZE 100
+
+// Phases of a run of main, timed for slow-puzzle capture
+enum { RUN_READ, RUN_SOLVE, RUN_FILL, RUN_VALIDATE, RUN_PRINT, NUM_RUN_PHASES };
+
+typedef struct {
+  double seconds[NUM_RUN_PHASES];
+  int fill_passes;  // Fill-in passes (bands: rounds) of the last checkPuzzle
+} run_profile;
+
+// Filled in by main and checkPuzzle
+run_profile last_run;
+
+// Settings for one board size from a tuning profile (see Host Autotuner)
+typedef struct {
+  int psize;
+  int validate_threads;
+  int fill_threads;
+  bool fill_bands;     // Fill in by bands rather than by units
+  int search_threads;
+} tune_entry;
+
+// The loaded profile; empty unless main loaded one
+tune_entry *tune_entries = NULL;
+int num_tune_entries = 0;
+
 
 bool is_row_valid(int row, int psize, int **grid);
 bool is_col_valid(int col, int psize, int **grid);
 bool is_subgrid_valid(int start_row, int start_col, int psize, int **grid);
+bool perm9_unit_valid(int **grid, int kind, int unit);
+int fillPuzzleBands(int psize, int **grid, int num_threads);
+uint64_t rng_next(uint64_t *state);
+double now_seconds(void);
+const tune_entry *tune_lookup(int psize);
+int fillPuzzleThreads(int psize, int **grid, int num_threads);
+bool validatePuzzleThreads(int psize, int **grid, int num_threads);
+void printUsage(void);
+void copySudokuPuzzle(int psize, int **dst, int **src);
+void deleteSudokuPuzzle(int psize, int **grid);
 
 // --- Validation Worker Functions ---
 
@@ -38,7 +106,9 @@ void *check_cols(void *params) {
   parameters *p = (parameters *)params;
   p->result_arr[p->id] = 1; // Assume valid
   for (int i = 1; i <= p->psize; i++) {
-    if (!is_col_valid(i, p->psize, p->grid)) {
+    bool ok = p->psize == 9 ? perm9_unit_valid(p->grid, UNIT_COL, i - 1)
+                            : is_col_valid(i, p->psize, p->grid);
+    if (!ok) {
       p->result_arr[p->id] = 0; // Found invalid column
       break;
     }
@@ -56,7 +126,9 @@ void *check_rows(void *params) {
   parameters *p = (parameters *)params;
   p->result_arr[p->id] = 1; // Assume valid
   for (int i = 1; i <= p->psize; i++) {
-    if (!is_row_valid(i, p->psize, p->grid)) {
+    bool ok = p->psize == 9 ? perm9_unit_valid(p->grid, UNIT_ROW, i - 1)
+                            : is_row_valid(i, p->psize, p->grid);
+    if (!ok) {
       p->result_arr[p->id] = 0; // Found invalid row
       break;
     }
@@ -82,7 +154,10 @@ void *check_subgrid(void *params) {
   int start_row = (subgrid_idx / subgrid_size) * subgrid_size + 1;
   int start_col = (subgrid_idx % subgrid_size) * subgrid_size + 1;
 
-  if (is_subgrid_valid(start_row, start_col, p->psize, p->grid)) {
+  bool ok = p->psize == 9
+                ? perm9_unit_valid(p->grid, UNIT_BOX, subgrid_idx)
+                : is_subgrid_valid(start_row, start_col, p->psize, p->grid);
+  if (ok) {
     p->result_arr[p->id] = 1;
   } else {
     p->result_arr[p->id] = 0;
@@ -301,6 +376,123 @@ bool is_subgrid_valid(int start_row, int start_col, int psize, int **grid) {
   return true;
 }
 
+// --- 9x9 Permutation Validation ---
+
+/*
+ * A unit of a completed 9x9 board is valid iff its nine values are a
+ * permutation of 1..9. Two scalar alternatives to the bool seen[] loop:
+ *
+ * - table: pack the nine values, 4 bits each, into a 36-bit key and look it
+ *   up in a hash set holding all 362,880 permutation keys;
+ * - mask: OR 1 << v over the unit and compare against the mask of 1..9.
+ *
+ * Both are timed against is_*_valid by --microbench. The mask is the fastest
+ * (the table is 8MB, so lookups miss cache), so perm9_unit_valid uses it.
+ */
+
+#define PERM9_TABLE_BITS 20
+#define PERM9_FULL_MASK 0x3FEu // Bits 1..9
+
+uint64_t *perm9_table; // Open addressing, linear probing; 0 is empty
+pthread_once_t perm9_table_once = PTHREAD_ONCE_INIT;
+
+uint32_t perm9_hash(uint64_t key) {
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - PERM9_TABLE_BITS));
+}
+
+/**
+ * @brief Fills perm9_table with the keys of every permutation of 1..9,
+ * generated with Heap's algorithm; leaves it NULL if out of memory.
+ */
+void perm9_build_table(void) {
+  perm9_table = (uint64_t *)calloc(1u << PERM9_TABLE_BITS, sizeof(uint64_t));
+  if (perm9_table == NULL) { return; }
+  int v[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  int c[9] = {0};
+  for (int i = 0;;) {
+    uint64_t key = 0;
+    for (int k = 0; k < 9; k++) { key |= (uint64_t)v[k] << (4 * k); }
+    uint32_t h = perm9_hash(key);
+    while (perm9_table[h] != 0) { h = (h + 1) & ((1u << PERM9_TABLE_BITS) - 1); }
+    perm9_table[h] = key;
+
+    while (i < 9 && c[i] >= i) { c[i++] = 0; }
+    if (i == 9) { break; }
+    int j = (i % 2 == 0) ? 0 : c[i];
+    int t = v[j];
+    v[j] = v[i];
+    v[i] = t;
+    c[i]++;
+    i = 0;
+  }
+}
+
+/**
+ * @brief Copies the nine values of a 9x9 unit into v.
+ * @param kind UNIT_ROW, UNIT_COL or UNIT_BOX.
+ * @param unit The unit index, 0 to 8.
+ */
+void unit9_values(int **grid, int kind, int unit, int v[9]) {
+  if (kind == UNIT_ROW) {
+    for (int i = 0; i < 9; i++) { v[i] = grid[unit + 1][i + 1]; }
+  } else if (kind == UNIT_COL) {
+    for (int i = 0; i < 9; i++) { v[i] = grid[i + 1][unit + 1]; }
+  } else {
+    int r0 = (unit / 3) * 3 + 1, c0 = (unit % 3) * 3 + 1;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) { v[3 * i + j] = grid[r0 + i][c0 + j]; }
+    }
+  }
+}
+
+/**
+ * @brief Checks a 9x9 unit with a branch-free bitmask of the values seen.
+ * @details Nine values in 1..9 that cover all of 1..9 must be distinct.
+ * @return true if the unit is a permutation of 1..9.
+ */
+bool perm9_mask_valid(int **grid, int kind, int unit) {
+  int v[9];
+  unit9_values(grid, kind, unit, v);
+  unsigned mask = 0, bad = 0;
+  for (int i = 0; i < 9; i++) {
+    bad |= (unsigned)(v[i] - 1) > 8;
+    mask |= 1u << (v[i] & 15);
+  }
+  return !bad && mask == PERM9_FULL_MASK;
+}
+
+/**
+ * @brief Checks a 9x9 unit by looking its packed key up in perm9_table, or
+ * with perm9_mask_valid if the table could not be allocated.
+ * @return true if the unit is a permutation of 1..9.
+ */
+bool perm9_table_valid(int **grid, int kind, int unit) {
+  pthread_once(&perm9_table_once, perm9_build_table);
+  if (perm9_table == NULL) { return perm9_mask_valid(grid, kind, unit); }
+  int v[9];
+  unit9_values(grid, kind, unit, v);
+  uint64_t key = 0;
+  unsigned bad = 0;
+  for (int i = 0; i < 9; i++) {
+    bad |= (unsigned)(v[i] - 1) > 8; // The key only holds 1..9 faithfully
+    key |= (uint64_t)(v[i] & 15) << (4 * i);
+  }
+  if (bad) { return false; }
+  for (uint32_t h = perm9_hash(key); perm9_table[h] != 0;
+       h = (h + 1) & ((1u << PERM9_TABLE_BITS) - 1)) {
+    if (perm9_table[h] == key) { return true; }
+  }
+  return false;
+}
+
+/**
+ * @brief Fastest validator for a unit of a completed 9x9 board; used in place
+ * of is_*_valid when psize is 9.
+ */
+bool perm9_unit_valid(int **grid, int kind, int unit) {
+  return perm9_mask_valid(grid, kind, unit);
+}
+
 // --- Solver Thread Entry Points ---
 
 /**
@@ -374,7 +566,8 @@ void *solve_subgrid_worker(void *params) {
  * enters an iterative solving phase, repeatedly launching solver threads until
  * no more 'easy' cells can be filled. After attempting to solve, it launches
  * validation threads to check if the final grid is a complete and valid Sudoku
- * solution.
+ * solution. Boards of BAND_MIN_PSIZE and up are filled in by bands instead
+ * (fillPuzzleBands), one thread per band.
  * @param psize The size of the puzzle (e.g., 9 for a 9x9 grid).
  * @param grid The 2D array representing the Sudoku puzzle.
  * @param complete A pointer to a boolean that will be set to true if the puzzle
@@ -401,38 +594,53 @@ void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
   }
 
   // If the puzzle is not complete, try to solve it.
+  const tune_entry *tune = tune_lookup(psize);
+  double t0 = now_seconds();
+  last_run.fill_passes = 0;
   if (!*complete) {
     *valid = false;
-    int zeros_filled_in_pass;
-    pthread_mutex_t lock;
-    pthread_mutex_init(&lock, NULL);
+    if (tune != NULL) {
+      // Thread count and mode from the tuning profile
+      last_run.fill_passes =
+          tune->fill_bands
+              ? fillPuzzleBands(psize, grid, tune->fill_threads)
+              : fillPuzzleThreads(psize, grid, tune->fill_threads);
+    } else if (psize >= BAND_MIN_PSIZE) {
+      // One thread per band of subgrid rows instead of rows/columns/subgrids
+      last_run.fill_passes = fillPuzzleBands(psize, grid, sqrt(psize));
+    } else {
+      int zeros_filled_in_pass;
+      pthread_mutex_t lock;
+      pthread_mutex_init(&lock, NULL);
 
-    do {
-      zeros_filled_in_pass = 0;
-      // Launch solver threads for rows, cols, and subgrids
-      for (int i = 0; i < num_threads; i++) {
-        parameters *data = (parameters *)malloc(sizeof(parameters));
-        data->id = i;
-        data->psize = psize;
-        data->grid = grid;
-        data->filled_count = &zeros_filled_in_pass;
-        data->lock = &lock;
-
-        if (i == 0) { // Thread 0 for rows
-          pthread_create(&threads[i], NULL, solve_rows_worker, data);
-        } else if (i == 1) { // Thread 1 for columns
-          pthread_create(&threads[i], NULL, solve_cols_worker, data);
-        } else { // Threads 2 to N+1 for subgrids
-          pthread_create(&threads[i], NULL, solve_subgrid_worker, data);
+      do {
+        zeros_filled_in_pass = 0;
+        last_run.fill_passes++;
+        // Launch solver threads for rows, cols, and subgrids
+        for (int i = 0; i < num_threads; i++) {
+          parameters *data = (parameters *)malloc(sizeof(parameters));
+          data->id = i;
+          data->psize = psize;
+          data->grid = grid;
+          data->filled_count = &zeros_filled_in_pass;
+          data->lock = &lock;
+
+          if (i == 0) { // Thread 0 for rows
+            pthread_create(&threads[i], NULL, solve_rows_worker, data);
+          } else if (i == 1) { // Thread 1 for columns
+            pthread_create(&threads[i], NULL, solve_cols_worker, data);
+          } else { // Threads 2 to N+1 for subgrids
+            pthread_create(&threads[i], NULL, solve_subgrid_worker, data);
+          }
         }
-      }
-      // Wait for all solver threads to finish this pass
-      for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
-      }
-    } while (zeros_filled_in_pass > 0); // Repeat if made progress
+        // Wait for all solver threads to finish this pass
+        for (int i = 0; i < num_threads; i++) {
+          pthread_join(threads[i], NULL);
+        }
+      } while (zeros_filled_in_pass > 0); // Repeat if made progress
 
-    pthread_mutex_destroy(&lock);
+      pthread_mutex_destroy(&lock);
+    }
 
     // After solving, re-check if the puzzle is now complete
     *complete = true;
@@ -445,6 +653,13 @@ void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
   }
 
   // --- Multi-threaded Validation ---
+  double t1 = now_seconds();
+  last_run.seconds[RUN_FILL] = t1 - t0;
+  if (tune != NULL) {
+    *valid = validatePuzzleThreads(psize, grid, tune->validate_threads);
+    last_run.seconds[RUN_VALIDATE] = now_seconds() - t1;
+    return;
+  }
   int thread_results[num_threads];
 
   // Create and launch threads
@@ -479,88 +694,8374 @@ void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
       break;
     }
   }
+  last_run.seconds[RUN_VALIDATE] = now_seconds() - t1;
 }
 
+// --- Thread-Count-Independent Workers ---
+
+/*
+ * checkPuzzle always uses psize + 2 threads: one for all rows, one for all
+ * columns and one per subgrid. The functions below split the same work into
+ * 3 * psize units (rows, then columns, then subgrids) that are dealt out
+ * round-robin to any number of threads, so the thread count can be varied
+ * independently of the board size.
+ */
+
 /**
- * @brief Reads a Sudoku puzzle from a file.
- * @param filename The path to the puzzle file.
- * @param grid A pointer to a 2D int array that will be allocated and filled
- * with the puzzle data.
- * @return The size of the puzzle.
+ * @brief Validates or solves a single unit.
+ * @param unit The unit number, 0 to 3 * psize - 1.
+ * @param solve true to call the solve_* helper, false for the is_*_valid one.
+ * @return For validation 1 if the unit is valid; for solving 1 if a zero was
+ * filled. 0 otherwise.
  */
-int readSudokuPuzzle(char *filename, int ***grid) { // NOLINT
-  FILE *fp = fopen(filename, "r");
-  if (fp == NULL) {
-    printf("Could not open file %s\n", filename);
-    exit(EXIT_FAILURE);
+int process_unit(int unit, int psize, int **grid, bool solve) {
+  int idx = unit % psize;
+  if (psize == 9 && !solve) { return perm9_unit_valid(grid, unit / 9, idx); }
+  int subgrid_size = sqrt(psize);
+  switch (unit / psize) {
+  case 0:
+    return solve ? solve_row(idx + 1, psize, grid)
+                 : is_row_valid(idx + 1, psize, grid);
+  case 1:
+    return solve ? solve_col(idx + 1, psize, grid)
+                 : is_col_valid(idx + 1, psize, grid);
+  default: {
+    int start_row = (idx / subgrid_size) * subgrid_size + 1;
+    int start_col = (idx % subgrid_size) * subgrid_size + 1;
+    return solve ? solve_subgrid(start_row, start_col, psize, grid)
+                 : is_subgrid_valid(start_row, start_col, psize, grid);
+  }
+  }
+}
+
+/**
+ * @brief Worker function that validates every num_threads-th unit.
+ * @param params A void pointer to a parameters struct.
+ * @return NULL. The result is written to the shared result_arr.
+ */
+void *check_units(void *params) {
+  parameters *p = (parameters *)params;
+  p->result_arr[p->id] = 1;
+  for (int u = p->id; u < 3 * p->psize; u += p->num_threads) {
+    if (!process_unit(u, p->psize, p->grid, false)) {
+      p->result_arr[p->id] = 0;
+      break;
+    }
+  }
+  free(p);
+  return NULL;
+}
+
+/**
+ * @brief Worker function that runs the solve_* helper on every
+ * num_threads-th unit.
+ * @param params A void pointer to a parameters struct.
+ * @return NULL. Filled zeros are added to the shared filled_count.
+ */
+void *solve_units(void *params) {
+  parameters *p = (parameters *)params;
+  int filled_this_thread = 0;
+  for (int u = p->id; u < 3 * p->psize; u += p->num_threads) {
+    filled_this_thread += process_unit(u, p->psize, p->grid, true);
+  }
+  if (filled_this_thread > 0) {
+    pthread_mutex_lock(p->lock);
+    *(p->filled_count) += filled_this_thread;
+    pthread_mutex_unlock(p->lock);
+  }
+  free(p);
+  return NULL;
+}
+
+/**
+ * @brief Runs the fill-in loop with a given number of threads.
+ * @details Same loop as in checkPuzzle: passes repeat until one fills no zero.
+ * @param num_threads Number of threads per pass; 1 runs on the caller.
+ * @return The number of passes made.
+ */
+int fillPuzzleThreads(int psize, int **grid, int num_threads) {
+  pthread_t threads[num_threads];
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, NULL);
+  int zeros_filled_in_pass;
+  int passes = 0;
+  do {
+    zeros_filled_in_pass = 0;
+    passes++;
+    for (int i = 0; i < num_threads; i++) {
+      parameters *data = (parameters *)malloc(sizeof(parameters));
+      data->id = i;
+      data->psize = psize;
+      data->grid = grid;
+      data->result_arr = NULL;
+      data->filled_count = &zeros_filled_in_pass;
+      data->lock = &lock;
+      data->num_threads = num_threads;
+      if (num_threads == 1) {
+        solve_units(data);
+      } else {
+        pthread_create(&threads[i], NULL, solve_units, data);
+      }
+    }
+    for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+  } while (zeros_filled_in_pass > 0);
+  pthread_mutex_destroy(&lock);
+  return passes;
+}
+
+/**
+ * @brief Validates a completed puzzle with a given number of threads.
+ * @param num_threads Number of threads; 1 runs on the caller.
+ * @return true if every row, column and subgrid is valid.
+ */
+bool validatePuzzleThreads(int psize, int **grid, int num_threads) {
+  pthread_t threads[num_threads];
+  int thread_results[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    parameters *data = (parameters *)malloc(sizeof(parameters));
+    data->id = i;
+    data->psize = psize;
+    data->grid = grid;
+    data->result_arr = thread_results;
+    data->filled_count = NULL;
+    data->lock = NULL;
+    data->num_threads = num_threads;
+    if (num_threads == 1) {
+      check_units(data);
+    } else {
+      pthread_create(&threads[i], NULL, check_units, data);
+    }
+  }
+  for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (thread_results[i] == 0) { return false; }
+  }
+  return true;
+}
+
+/**
+ * @brief Returns true if the grid has no zeros.
+ */
+bool isPuzzleComplete(int psize, int **grid) {
+  for (int i = 1; i <= psize; i++) {
+    for (int j = 1; j <= psize; j++) {
+      if (grid[i][j] == 0) { return false; }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Same as checkPuzzle, but with a caller-chosen number of threads.
+ * @param num_threads Number of threads for both the fill-in and validation
+ * phases.
+ */
+void checkPuzzleThreads(int psize, int **grid, int num_threads, bool *complete,
+                        bool *valid) {
+  *complete = isPuzzleComplete(psize, grid);
+  if (!*complete) {
+    fillPuzzleThreads(psize, grid, num_threads);
+    *complete = isPuzzleComplete(psize, grid);
   }
+  *valid = validatePuzzleThreads(psize, grid, num_threads);
+}
+
+// --- Band-Partitioned Fill-In ---
+
+/*
+ * On very large boards a single fill-in pass is itself heavy, and checkPuzzle
+ * gives all rows to one thread and all columns to another. fillPuzzleBands
+ * instead splits the board into bands: the sqrt(psize) rows of one row of
+ * subgrids. Rows and subgrids lie wholly inside a band, so each worker fills
+ * them for its bands until they settle without touching anyone else's cells.
+ * Columns cross every band: each band summarizes its part of every column
+ * (zero count, where the zero is, sum and values seen), and after a barrier
+ * the band holding a column's only zero fills it from the summaries of all
+ * bands. Rounds repeat until one fills nothing.
+ */
+
+typedef struct {
   int psize;
-  fscanf(fp, "%d", &psize);
-  int **agrid = (int **)malloc((psize + 1) * sizeof(int *));
-  for (int row = 1; row <= psize; row++) {
-    agrid[row] = (int *)malloc((psize + 1) * sizeof(int));
-    for (int col = 1; col <= psize; col++) {
-      fscanf(fp, "%d", &agrid[row][col]);
+  int box;             // Subgrid width, also the number of bands
+  int words;           // 64-bit words per seen bitset
+  int num_threads;
+  int **grid;
+  int *col_zeros;      // [band * psize + col - 1]: zeros in the band's part
+  int *col_zero_row;   // Row of the (last) zero in the band's part
+  long *col_sum;       // Sum of the valid values in the band's part
+  uint64_t *col_seen;  // words per (band, col): values present, bit v - 1
+  int fills[2];        // Cells filled, by round parity
+  int rounds;
+  pthread_barrier_t barrier;
+} band_shared;
+
+typedef struct {
+  band_shared *shared;
+  int id;              // This worker owns bands id, id + num_threads, ...
+} band_task;
+
+/**
+ * @brief Records the band's part of every column in the column summaries.
+ */
+void band_summarize(band_shared *sh, int band) {
+  int psize = sh->psize;
+  int *zeros = sh->col_zeros + (size_t)band * psize;
+  int *zero_row = sh->col_zero_row + (size_t)band * psize;
+  long *sum = sh->col_sum + (size_t)band * psize;
+  uint64_t *seen = sh->col_seen + (size_t)band * psize * sh->words;
+  memset(zeros, 0, psize * sizeof(int));
+  memset(sum, 0, psize * sizeof(long));
+  memset(seen, 0, (size_t)psize * sh->words * sizeof(uint64_t));
+  // Row by row, so the grid is read in memory order
+  for (int r = band * sh->box + 1; r <= (band + 1) * sh->box; r++) {
+    for (int c = 0; c < psize; c++) {
+      int num = sh->grid[r][c + 1];
+      if (num == 0) {
+        zeros[c]++;
+        zero_row[c] = r;
+      } else if (num > 0 && num <= psize) {
+        sum[c] += num;
+        seen[c * sh->words + ((num - 1) >> 6)] |= 1ULL << ((num - 1) & 63);
+      }
     }
   }
-  fclose(fp);
-  *grid = agrid;
-  return psize;
 }
 
 /**
- * @brief Prints the Sudoku puzzle to the console.
- * @param psize The size of the puzzle.
- * @param grid The 2D array representing the puzzle.
+ * @brief Fills the columns whose only zero lies in this band, from the
+ * summaries of all bands (the same rule as solve_col).
+ * @return The number of zeros filled.
  */
-void printSudokuPuzzle(int psize, int **grid) { // NOLINT
-  printf("%d\n", psize);
-  for (int row = 1; row <= psize; row++) {
-    for (int col = 1; col <= psize; col++) {
-      printf("%d ", grid[row][col]);
+int band_fill_columns(band_shared *sh, int band) {
+  int psize = sh->psize;
+  long expected_sum = (long)psize * (psize + 1) / 2;
+  int filled = 0;
+  for (int c = 0; c < psize; c++) {
+    if (sh->col_zeros[(size_t)band * psize + c] != 1) { continue; }
+    int zeros = 0;
+    long sum = 0;
+    for (int b = 0; b < sh->box && zeros < 2; b++) {
+      zeros += sh->col_zeros[(size_t)b * psize + c];
+      sum += sh->col_sum[(size_t)b * psize + c];
+    }
+    if (zeros != 1) { continue; }
+    long missing_num = expected_sum - sum;
+    if (missing_num < 1 || missing_num > psize) { continue; }
+    int w = (missing_num - 1) >> 6;
+    uint64_t bit = 1ULL << ((missing_num - 1) & 63);
+    bool seen = false;
+    for (int b = 0; b < sh->box && !seen; b++) {
+      seen = sh->col_seen[((size_t)b * psize + c) * sh->words + w] & bit;
+    }
+    if (!seen) {
+      sh->grid[sh->col_zero_row[(size_t)band * psize + c]][c + 1] = missing_num;
+      filled++;
     }
-    printf("\n");
   }
-  printf("\n");
+  return filled;
 }
 
 /**
- * @brief Frees the memory allocated for the Sudoku grid.
- * @param psize The size of the puzzle.
- * @param grid The 2D array to be freed.
+ * @brief Worker function that runs the fill-in rounds for its bands.
+ * @param arg A band_task.
+ * @return NULL.
  */
-void deleteSudokuPuzzle(int psize, int **grid) {
-  for (int row = 1; row <= psize; row++) {
-    free(grid[row]);
+void *band_worker(void *arg) {
+  band_task *t = (band_task *)arg;
+  band_shared *sh = t->shared;
+  int psize = sh->psize;
+  for (int round = 0;; round++) {
+    int filled = 0;
+    for (int band = t->id; band < sh->box; band += sh->num_threads) {
+      int first_row = band * sh->box + 1;
+      int local;
+      do {
+        local = 0;
+        for (int r = first_row; r < first_row + sh->box; r++) {
+          local += solve_row(r, psize, sh->grid);
+        }
+        for (int c = 1; c <= psize; c += sh->box) {
+          local += solve_subgrid(first_row, c, psize, sh->grid);
+        }
+        filled += local;
+      } while (local > 0);
+      band_summarize(sh, band);
+    }
+    pthread_barrier_wait(&sh->barrier);
+    for (int band = t->id; band < sh->box; band += sh->num_threads) {
+      filled += band_fill_columns(sh, band);
+    }
+    __atomic_add_fetch(&sh->fills[round & 1], filled, __ATOMIC_RELAXED);
+    pthread_barrier_wait(&sh->barrier);
+    int total = __atomic_load_n(&sh->fills[round & 1], __ATOMIC_RELAXED);
+    if (t->id == 0) {
+      // Everyone read last round's count before the barrier just passed
+      sh->fills[(round + 1) & 1] = 0;
+      sh->rounds = round + 1;
+    }
+    if (total == 0) { break; }
   }
-  free(grid);
+  return NULL;
 }
 
-// expects file name of the puzzle as argument in command line
 /**
- * @brief Main entry point of the program.
- * @param argc The number of command-line arguments.
- * @param argv An array of command-line arguments. Expects one argument: the puzzle filename.
+ * @brief Runs the fill-in loop with the board split into bands.
+ * @details Fills the same cells as fillPuzzleThreads; see the section
+ * comment for how the work is divided.
+ * @param num_threads Number of workers, at most sqrt(psize); 1 runs on the
+ * caller.
+ * @return The number of rounds made.
  */
-int main(int argc, char **argv) { 
-  if (argc != 2) {
-    printf("usage: ./sudoku puzzle.txt\n");
-    return EXIT_FAILURE;
+int fillPuzzleBands(int psize, int **grid, int num_threads) {
+  band_shared sh;
+  sh.psize = psize;
+  sh.box = sqrt(psize);
+  sh.words = (psize + 63) / 64;
+  sh.num_threads = num_threads < 1 ? 1 : num_threads;
+  if (sh.num_threads > sh.box) { sh.num_threads = sh.box; }
+  sh.grid = grid;
+  size_t entries = (size_t)sh.box * psize;
+  sh.col_zeros = (int *)malloc(entries * sizeof(int));
+  sh.col_zero_row = (int *)malloc(entries * sizeof(int));
+  sh.col_sum = (long *)malloc(entries * sizeof(long));
+  sh.col_seen = (uint64_t *)malloc(entries * sh.words * sizeof(uint64_t));
+  sh.fills[0] = sh.fills[1] = 0;
+  sh.rounds = 0;
+  pthread_barrier_init(&sh.barrier, NULL, sh.num_threads);
+  band_task tasks[sh.num_threads];
+  pthread_t threads[sh.num_threads];
+  for (int i = 0; i < sh.num_threads; i++) {
+    tasks[i].shared = &sh;
+    tasks[i].id = i;
+    if (sh.num_threads == 1) {
+      band_worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, band_worker, &tasks[i]);
+    }
   }
-  // grid is a 2D array
-  int **grid = NULL;
-  // find grid size and fill grid
-  int sudokuSize = readSudokuPuzzle(argv[1], &grid);
-  bool valid = false;
-  bool complete = false;
-  checkPuzzle(sudokuSize, grid, &complete, &valid);
-  printf("Complete puzzle? ");
-  printf(complete ? "true\n" : "false\n");
-  if (complete) {
-    printf("Valid puzzle? ");
-    printf(valid ? "true\n" : "false\n");
+  for (int i = 0; sh.num_threads > 1 && i < sh.num_threads; i++) {
+    pthread_join(threads[i], NULL);
   }
-  printSudokuPuzzle(sudokuSize, grid);
-  deleteSudokuPuzzle(sudokuSize, grid);
-  return EXIT_SUCCESS;
+  pthread_barrier_destroy(&sh.barrier);
+  free(sh.col_zeros);
+  free(sh.col_zero_row);
+  free(sh.col_sum);
+  free(sh.col_seen);
+  return sh.rounds;
+}
+
+// --- Memory ---
+
+/*
+ * Large boards (HUGE_PAGE_MIN_PSIZE and up) keep their grid and all solver
+ * storage on 2 MB pages to cut dTLB misses. hugeAlloc first asks for explicit
+ * huge pages (MAP_HUGETLB), then for an aligned region marked for transparent
+ * huge pages, and finally falls back to malloc.
+ */
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define HUGE_PAGE_MIN_PSIZE 100
+
+// Set to false to keep every allocation on normal pages (used by benchmarks)
+bool huge_pages_enabled = true;
+
+/*
+ * All puzzle and solver memory goes through hugeAlloc, which counts it in
+ * mem_in_use and refuses requests beyond mem_budget (0 means no limit).
+ */
+size_t mem_budget = 0;
+size_t mem_in_use = 0;
+
+/**
+ * @brief Reserves bytes against the memory budget.
+ * @return false (and reserves nothing) if the budget would be exceeded.
+ */
+bool mem_reserve(size_t bytes) {
+  size_t now = __atomic_add_fetch(&mem_in_use, bytes, __ATOMIC_RELAXED);
+  if (mem_budget > 0 && now > mem_budget) {
+    __atomic_sub_fetch(&mem_in_use, bytes, __ATOMIC_RELAXED);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Parses a memory size such as "4096", "512K", "64M" or "2G".
+ * @return The size in bytes, or 0 if the text is not a size.
+ */
+size_t parseMemorySize(const char *text) {
+  char *end;
+  double value = strtod(text, &end);
+  if (end == text || value <= 0) { return 0; }
+  switch (*end) {
+  case 'k': case 'K': value *= 1024; end++; break;
+  case 'm': case 'M': value *= 1024.0 * 1024; end++; break;
+  case 'g': case 'G': value *= 1024.0 * 1024 * 1024; end++; break;
+  default: break;
+  }
+  return *end == '\0' ? (size_t)value : 0;
+}
+
+enum { MEM_MALLOC, MEM_THP, MEM_HUGETLB };
+const char *mem_kind_names[] = {"malloc", "thp", "hugetlb"};
+
+// Header in front of every hugeAlloc block; 64 bytes keeps the data aligned
+typedef struct {
+  void *map;        // Start of the mapping (or malloc block)
+  size_t map_size;  // Bytes mapped; 0 for malloc
+  size_t charged;   // Bytes counted against the memory budget
+  int kind;         // MEM_*
+  char pad[64 - sizeof(void *) - 2 * sizeof(size_t) - sizeof(int)];
+} huge_header;
+
+/**
+ * @brief Allocates zeroed memory, on huge pages if asked and possible.
+ * @param bytes Bytes wanted.
+ * @param want_huge true to try huge pages; the block is then rounded up to
+ * whole 2 MB pages.
+ * @return The block, or NULL if out of memory or over the memory budget.
+ * Free it with hugeFree.
+ */
+void *hugeAlloc(size_t bytes, bool want_huge) {
+  size_t total = bytes + sizeof(huge_header);
+  huge_header *h = NULL;
+#ifdef __linux__
+  if (want_huge && huge_pages_enabled) {
+    size_t map_size = (total + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    // Huge pages are charged in full; fall back to small pages if that
+    // does not fit
+    if (mem_reserve(map_size)) {
+      void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (map != MAP_FAILED) {
+        h = (huge_header *)map;
+        h->map = map;
+        h->map_size = map_size;
+        h->charged = map_size;
+        h->kind = MEM_HUGETLB;
+        return h + 1;
+      }
+      // No reserved huge pages: map one extra page so the region can be
+      // aligned to 2 MB, which transparent huge pages need
+      map = mmap(NULL, map_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (map != MAP_FAILED) {
+        uintptr_t aligned = ((uintptr_t)map + HUGE_PAGE_SIZE - 1) &
+                            ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+        madvise((void *)aligned, map_size, MADV_HUGEPAGE);
+        h = (huge_header *)aligned;
+        h->map = map;
+        h->map_size = map_size + HUGE_PAGE_SIZE;
+        h->charged = map_size;
+        h->kind = MEM_THP;
+        return h + 1;
+      }
+      __atomic_sub_fetch(&mem_in_use, map_size, __ATOMIC_RELAXED);
+    }
+  }
+#else
+  (void)want_huge;
+#endif
+  if (!mem_reserve(total)) { return NULL; }
+  h = (huge_header *)calloc(1, total);
+  if (h == NULL) {
+    __atomic_sub_fetch(&mem_in_use, total, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  h->map = h;
+  h->map_size = 0;
+  h->charged = total;
+  h->kind = MEM_MALLOC;
+  return h + 1;
+}
+
+/**
+ * @brief Returns which kind of memory backs a hugeAlloc block (MEM_*).
+ */
+int hugeKind(void *p) { return ((huge_header *)p - 1)->kind; }
+
+/**
+ * @brief Frees a block from hugeAlloc. NULL is ignored.
+ */
+void hugeFree(void *p) {
+  if (p == NULL) { return; }
+  huge_header *h = (huge_header *)p - 1;
+  __atomic_sub_fetch(&mem_in_use, h->charged, __ATOMIC_RELAXED);
+#ifdef __linux__
+  if (h->kind != MEM_MALLOC) {
+    munmap(h->map, h->map_size);
+    return;
+  }
+#endif
+  free(h->map);
+}
+
+/*
+ * An arena is a stack of chunks from hugeAlloc with bump allocation. Memory
+ * is given back in LIFO order with arena_release, which suits backtracking:
+ * a search level takes a mark before allocating and releases to it when it
+ * is popped.
+ */
+
+typedef struct arena_chunk {
+  struct arena_chunk *prev;  // Chunk below this one
+  size_t size;               // Usable bytes after this header
+  size_t used;               // Bytes handed out
+} arena_chunk;
+
+typedef struct {
+  arena_chunk *top;    // Chunk allocations come from
+  arena_chunk *spare;  // One released chunk kept to avoid map/unmap churn
+  size_t chunk_size;   // Minimum size of a new chunk
+  bool huge;           // Chunks go on huge pages
+  size_t reserved;     // Bytes currently held in chunks
+} arena;
+
+typedef struct {
+  arena_chunk *chunk;
+  size_t used;
+} arena_mark;
+
+/**
+ * @brief Sets up an empty arena.
+ * @param huge true to put the chunks on huge pages; the chunk size is then
+ * raised to at least HUGE_PAGE_SIZE.
+ */
+void arena_init(arena *a, size_t chunk_size, bool huge) {
+  a->top = NULL;
+  a->spare = NULL;
+  a->huge = huge;
+  a->chunk_size = huge && chunk_size < HUGE_PAGE_SIZE - 64 - sizeof(arena_chunk)
+                      ? HUGE_PAGE_SIZE - 64 - sizeof(arena_chunk)
+                      : chunk_size;
+  a->reserved = 0;
+}
+
+/**
+ * @brief Allocates 64-byte aligned memory from the arena.
+ * @return The memory (not zeroed), or NULL if out of memory.
+ */
+void *arena_alloc(arena *a, size_t bytes) {
+  bytes = (bytes + 63) & ~(size_t)63;
+  if (a->top == NULL || a->top->used + bytes > a->top->size) {
+    arena_chunk *c = a->spare;
+    if (c != NULL && c->size >= bytes) {
+      a->spare = NULL;
+    } else {
+      size_t size = bytes > a->chunk_size ? bytes : a->chunk_size;
+      c = (arena_chunk *)hugeAlloc(sizeof(arena_chunk) + 64 + size, a->huge);
+      if (c == NULL && size > bytes) {
+        // A full chunk is over the memory budget; try just what is needed
+        size = bytes;
+        c = (arena_chunk *)hugeAlloc(sizeof(arena_chunk) + 64 + size, false);
+      }
+      if (c == NULL) { return NULL; }
+      c->size = size;
+      a->reserved += size;
+    }
+    c->prev = a->top;
+    c->used = 0;
+    a->top = c;
+  }
+  // Data starts on the first 64-byte boundary after the chunk header
+  char *base = (char *)(((uintptr_t)(a->top + 1) + 63) & ~(uintptr_t)63);
+  void *p = base + a->top->used;
+  a->top->used += bytes;
+  return p;
+}
+
+/**
+ * @brief Returns the current top of the arena, for arena_release.
+ */
+arena_mark arena_get_mark(const arena *a) {
+  arena_mark m = {a->top, a->top != NULL ? a->top->used : 0};
+  return m;
+}
+
+/**
+ * @brief Frees everything allocated after the mark was taken.
+ */
+void arena_release(arena *a, arena_mark m) {
+  while (a->top != m.chunk) {
+    arena_chunk *c = a->top;
+    a->top = c->prev;
+    if (a->spare == NULL) {
+      a->spare = c;
+    } else {
+      a->reserved -= c->size;
+      hugeFree(c);
+    }
+  }
+  if (a->top != NULL) { a->top->used = m.used; }
+}
+
+/**
+ * @brief Frees all chunks of the arena.
+ */
+void arena_destroy(arena *a) {
+  arena_mark empty = {NULL, 0};
+  arena_release(a, empty);
+  if (a->spare != NULL) {
+    a->reserved -= a->spare->size;
+    hugeFree(a->spare);
+    a->spare = NULL;
+  }
+}
+
+/**
+ * @brief Allocates an empty (all zero) puzzle with 1-based rows and columns.
+ * @details The cells are one contiguous block, on huge pages for large
+ * boards; grid[0] points to the start of the block.
+ * @param psize The size of the puzzle.
+ * @return The grid, or NULL if out of memory or over the memory budget;
+ * free it with deleteSudokuPuzzle.
+ */
+int **allocSudokuPuzzle(int psize) {
+  int **agrid = (int **)hugeAlloc((psize + 1) * sizeof(int *), false);
+  int *cells = (int *)hugeAlloc((size_t)(psize + 1) * (psize + 1) * sizeof(int),
+                                psize >= HUGE_PAGE_MIN_PSIZE);
+  if (agrid == NULL || cells == NULL) {
+    hugeFree(agrid);
+    hugeFree(cells);
+    return NULL;
+  }
+  for (int row = 0; row <= psize; row++) {
+    agrid[row] = cells + (size_t)row * (psize + 1);
+  }
+  return agrid;
+}
+
+// --- Puzzle Tokenizer ---
+
+/*
+ * Puzzle files are a size followed by psize * psize whitespace-separated
+ * integers; anything after the last cell is ignored. The tokenizer works on
+ * the whole file in memory instead of one fscanf per cell: with SSE2 it
+ * classifies 16 bytes at a time to skip whitespace runs and to find the end
+ * of each digit run, then converts the digits without going through stdio or
+ * the locale.
+ */
+
+typedef struct {
+  const char *buf;  // Text being parsed
+  size_t len;       // Bytes in buf
+  size_t pos;       // Next byte to look at
+} tokenizer;
+
+/**
+ * @brief Returns true for the bytes isspace accepts in the C locale.
+ */
+bool is_space_byte(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+#ifdef __SSE2__
+/**
+ * @brief Bitmask of the whitespace bytes among 16 bytes at p.
+ */
+int sse2_space_mask(const char *p) {
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+  return _mm_movemask_epi8(_mm_or_si128(sp, ctl));
+}
+
+/**
+ * @brief Bitmask of the digit bytes among 16 bytes at p.
+ */
+int sse2_digit_mask(const char *p) {
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  return _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+}
+#endif
+
+/**
+ * @brief Reads the next integer.
+ * @param value Output: the integer.
+ * @return 1 if an integer was read, 0 at the end of the text, -1 if the next
+ * token is not an integer or does not fit in an int.
+ */
+int tokenizer_next(tokenizer *t, int *value) {
+  const char *buf = t->buf;
+  size_t pos = t->pos, len = t->len;
+#ifdef __SSE2__
+  while (pos + 16 <= len) {
+    int ws = sse2_space_mask(buf + pos);
+    if (ws != 0xFFFF) {
+      pos += __builtin_ctz(~ws);
+      break;
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < len && is_space_byte(buf[pos])) { pos++; }
+  if (pos == len) {
+    t->pos = pos;
+    return 0;
+  }
+  bool negative = buf[pos] == '-';
+  if (buf[pos] == '-' || buf[pos] == '+') { pos++; }
+  size_t start = pos;
+#ifdef __SSE2__
+  if (pos + 16 <= len) {
+    int digits = sse2_digit_mask(buf + pos);
+    pos += __builtin_ctz(~digits); // Stops at the first non-digit
+  }
+#endif
+  while (pos < len && buf[pos] >= '0' && buf[pos] <= '9') { pos++; }
+  size_t n = pos - start;
+  // The token must be digits up to whitespace or the end, and fit an int
+  if (n == 0 || n > 10 || (pos < len && !is_space_byte(buf[pos]))) {
+    return -1;
+  }
+  long long v = 0;
+  for (size_t i = start; i < pos; i++) { v = v * 10 + (buf[i] - '0'); }
+  if (v > 2147483647LL + negative) { return -1; }
+  *value = (int)(negative ? -v : v);
+  t->pos = pos;
+  return 1;
+}
+
+/**
+ * @brief Reads up to count integers into out.
+ * @details With SSE2, works on 16-byte chunks made only of digits and
+ * whitespace: number starts and ends come from the digit mask, and numbers
+ * of up to 4 digits are converted together with SWAR arithmetic. Anything
+ * else (signs, long numbers, numbers crossing chunks, the tail of the text)
+ * goes through tokenizer_next.
+ * @return The number of integers read; less than count at the end of the
+ * text or at a token that is not an integer.
+ */
+int tokenizer_read_ints(tokenizer *t, int *out, int count) {
+  int n = 0;
+#ifdef __SSE2__
+  const char *buf = t->buf;
+  while (n < count && t->pos + 16 <= t->len) {
+    const char *p = buf + t->pos;
+    int digits = sse2_digit_mask(p);
+    if ((digits | sse2_space_mask(p)) != 0xFFFF) {
+      if (tokenizer_next(t, &out[n]) != 1) { return n; }
+      n++;
+      continue;
+    }
+    // A number starts at a digit with no digit before it and is complete
+    // if its last digit is followed by whitespace inside the chunk. The
+    // chunk never starts inside a number, so the i-th end belongs to the
+    // i-th start.
+    unsigned starts = digits & ~(digits << 1);
+    unsigned ends = digits & ~(digits >> 1) & 0x7FFF;
+    int complete = __builtin_popcount(ends);
+    if (complete > count - n) { complete = count - n; }
+    int consumed = 0;
+    int i = 0;
+    for (; i < complete; i++) {
+      int s = __builtin_ctz(starts), e = __builtin_ctz(ends);
+      int len = e - s + 1;
+      if (len > 4) { break; }
+      starts &= starts - 1;
+      ends &= ends - 1;
+      if (s <= 12) {
+        uint32_t x;
+        memcpy(&x, p + s, 4);
+        x -= 0x30303030;
+        x <<= (4 - len) * 8; // Digits right-aligned after leading zeros
+        x = x * 10 + (x >> 8);
+        out[n++] = (x & 0xFF) * 100 + ((x >> 16) & 0xFF);
+      } else {
+        int v = 0;
+        for (int d = s; d <= e; d++) { v = v * 10 + (p[d] - '0'); }
+        out[n++] = v;
+      }
+      consumed = e + 1;
+    }
+    if (starts == 0) {
+      t->pos += 16; // The rest of the chunk is whitespace
+    } else if (consumed > 0) {
+      t->pos += consumed;
+    } else if (digits & 1) {
+      // A number at the very start that this path cannot take
+      if (tokenizer_next(t, &out[n]) != 1) { return n; }
+      n++;
+    } else {
+      t->pos += __builtin_ctz(starts);
+    }
+  }
+#endif
+  while (n < count && tokenizer_next(t, &out[n]) == 1) { n++; }
+  return n;
+}
+
+/**
+ * @brief Reads a whole file into memory.
+ * @param len Output: the file length.
+ * @return A NUL-terminated buffer to free, or NULL if it cannot be read.
+ */
+char *readWholeFile(const char *filename, size_t *len) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  struct stat st;
+  char *buf = NULL;
+  if (fstat(fd, &st) == 0 && (buf = (char *)malloc(st.st_size + 1)) != NULL) {
+    size_t got = 0;
+    ssize_t r = 1;
+    while (got < (size_t)st.st_size &&
+           (r = read(fd, buf + got, st.st_size - got)) > 0) {
+      got += r;
+    }
+    if (r < 0) {
+      free(buf);
+      buf = NULL;
+    } else {
+      buf[got] = '\0';
+      *len = got;
+    }
+  }
+  close(fd);
+  return buf;
+}
+
+/**
+ * @brief Reads a Sudoku puzzle from a file, reporting errors instead of
+ * exiting (for long-running callers such as the server mode).
+ * @param filename The path to the puzzle file.
+ * @param grid A pointer to a 2D int array that will be allocated and filled
+ * with the puzzle data.
+ * @return The size of the puzzle, or 0 after printing why it could not be
+ * read.
+ */
+int loadSudokuPuzzle(const char *filename, int ***grid) {
+  size_t len;
+  char *text = readWholeFile(filename, &len);
+  if (text == NULL) {
+    printf("Could not open file %s\n", filename);
+    return 0;
+  }
+  tokenizer tok = {text, len, 0};
+  int psize;
+  if (tokenizer_next(&tok, &psize) != 1 || psize < 1) {
+    printf("Could not read the puzzle size from %s\n", filename);
+    free(text);
+    return 0;
+  }
+  int **agrid = allocSudokuPuzzle(psize);
+  if (agrid == NULL) {
+    printf("Not enough memory for a %dx%d puzzle", psize, psize);
+    if (mem_budget > 0) { printf(" (budget %zu bytes)", mem_budget); }
+    printf("\n");
+    free(text);
+    return 0;
+  }
+  for (int row = 1; row <= psize; row++) {
+    int got = tokenizer_read_ints(&tok, &agrid[row][1], psize);
+    if (got != psize) {
+      printf("Could not read cell %d,%d from %s\n", row, got + 1, filename);
+      deleteSudokuPuzzle(psize, agrid);
+      free(text);
+      return 0;
+    }
+  }
+  free(text);
+  *grid = agrid;
+  return psize;
+}
+
+/**
+ * @brief Reads a Sudoku puzzle from a file; exits if it cannot be read.
+ * @param filename The path to the puzzle file.
+ * @param grid A pointer to a 2D int array that will be allocated and filled
+ * with the puzzle data.
+ * @return The size of the puzzle.
+ */
+int readSudokuPuzzle(char *filename, int ***grid) { // NOLINT
+  int psize = loadSudokuPuzzle(filename, grid);
+  if (psize == 0) { exit(EXIT_FAILURE); }
+  return psize;
+}
+
+/**
+ * @brief Prints the Sudoku puzzle to the console.
+ * @param psize The size of the puzzle.
+ * @param grid The 2D array representing the puzzle.
+ */
+void printSudokuPuzzle(int psize, int **grid) { // NOLINT
+  printf("%d\n", psize);
+  for (int row = 1; row <= psize; row++) {
+    for (int col = 1; col <= psize; col++) {
+      printf("%d ", grid[row][col]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+/**
+ * @brief Frees the memory allocated for the Sudoku grid.
+ * @param psize The size of the puzzle.
+ * @param grid The 2D array to be freed.
+ */
+void deleteSudokuPuzzle(int psize, int **grid) {
+  (void)psize;
+  hugeFree(grid[0]);
+  hugeFree(grid);
+}
+
+// --- Backtracking Search Engine ---
+
+/*
+ * The fill-in loop in checkPuzzle only fills units with a single zero. The
+ * search engine solves any puzzle: it keeps, for every row, column and
+ * subgrid, a bitset of the values used (bit v - 1 for value v, in 64-bit
+ * words so any psize works), assigns naked and hidden singles until none are
+ * left and then branches on the empty cell with the fewest candidates.
+ *
+ * Backtracking either copies the whole state at every branch (SEARCH_COPY,
+ * fastest restore), copies only the values of the cells that were empty in
+ * the puzzle, a byte each on boards up to 255x255 (SEARCH_COMPACT), or
+ * records assigned cells on a trail and undoes them (SEARCH_TRAIL, no
+ * per-level copies). All storage comes from an arena, on huge pages for
+ * large boards.
+ *
+ * When the memory budget runs out, the search is restarted with half the
+ * tasks, then with compact snapshots, then with the trail, and only fails
+ * with SEARCH_OUT_OF_MEMORY when even that does not fit.
+ *
+ * The state keeps a Zobrist hash, the XOR of a key per (cell, value)
+ * assigned, updated on every assign and unassign. States proven to be dead
+ * ends go into a fixed-size transposition table shared by all tasks, which
+ * is checked before a node is propagated and expanded. Within one search
+ * tree a state never repeats (siblings differ in the cell branched on), but
+ * the table outlives the restarts forced by the memory budget, so a restart
+ * skips every subtree the failed attempt already refuted.
+ *
+ * With opts.trace set, the search runs as one task and appends every step
+ * to the trace: each single it propagates (cell, value, rule and the pass of
+ * the propagation it came from), each guess at a branch point and each
+ * backtrack, as the trace length to go back to. A step is 8 bytes written
+ * to a growing buffer, so recording costs little; boards are rebuilt from
+ * the steps only when asked for (see Solve Trace). A traced search keeps a
+ * trail in every mode, and the naked singles of a propagation pass are
+ * recorded from it once the pass ends, so the scan over the cells has no
+ * tracing in it.
+ */
+
+enum { SEARCH_COPY, SEARCH_COMPACT, SEARCH_TRAIL };
+
+// Rules of trace steps
+enum { TRACE_NAKED, TRACE_HIDDEN_ROW, TRACE_HIDDEN_COL, TRACE_HIDDEN_BOX,
+       TRACE_GUESS, TRACE_BACKTRACK, NUM_TRACE_RULES };
+
+typedef struct {
+  uint32_t cell;   // Row-major from 0; for TRACE_BACKTRACK the number of
+                   // steps whose board the search returns to
+  uint16_t digit;  // 0 for TRACE_BACKTRACK
+  uint8_t rule;
+  uint8_t pass;    // Propagation pass within its node from 1, up to 255;
+                   // 0 for guesses and backtracks
+} trace_step;
+
+typedef struct {
+  trace_step *steps;
+  size_t len, cap;
+  int pass;        // Current propagation pass
+  bool failed;     // A step could not be stored; the trace is cut short
+} solve_trace;
+const char *search_mode_names[] = {"copy", "compact", "trail"};
+
+// Results of solvePuzzleSearch
+enum { SEARCH_SOLVED, SEARCH_NO_SOLUTION, SEARCH_OUT_OF_MEMORY,
+       SEARCH_NODE_LIMIT };
+
+typedef struct {
+  int threads;  // Root branches are split over this many tasks
+  int mode;     // SEARCH_COPY, SEARCH_COMPACT or SEARCH_TRAIL
+  int tt_bits;  // log2 of transposition table entries; 0 for no table
+  long max_nodes;  // Give up after this many nodes per task; 0 for no limit
+  solve_trace *trace;  // If not NULL, steps are recorded here (one task)
+} search_options;
+
+typedef struct {
+  long nodes;         // Values tried at branch points
+  long backtracks;    // Branch points exhausted
+  long propagations;  // Cells assigned as naked or hidden singles
+  int threads;        // Tasks the root was split into (last attempt)
+  int mode;           // Backtracking mode of the last attempt
+  int degradations;   // Restarts forced by the memory budget
+  long tt_probes;     // Transposition table lookups
+  long tt_hits;       // Lookups that found a known dead end
+  long tt_stores;     // Dead ends recorded
+} search_stats;
+
+typedef struct {
+  int psize;
+  int box;             // Subgrid width, sqrt(psize)
+  int words;           // 64-bit words per value bitset
+  int empty;           // Empty cells left
+  uint64_t hash;       // Zobrist hash of the assigned cells
+  uint64_t *row_used;  // psize bitsets
+  uint64_t *col_used;  // psize bitsets
+  uint64_t *box_used;  // psize bitsets
+  uint16_t *cells;     // psize * psize values, row-major, 0 = empty
+  solve_trace *trace;  // Propagated singles are recorded here if not NULL
+} search_state;
+
+/**
+ * @brief Bytes of one search_state's arrays (what a snapshot copies).
+ */
+size_t search_state_bytes(int psize) {
+  int words = (psize + 63) / 64;
+  size_t masks = 3 * (size_t)psize * words * sizeof(uint64_t);
+  size_t cells = (size_t)psize * psize * sizeof(uint16_t);
+  return masks + ((cells + 63) & ~(size_t)63);
+}
+
+/**
+ * @brief Points a state's arrays into mem (search_state_bytes long).
+ */
+void search_state_bind(search_state *s, int psize, void *mem) {
+  s->psize = psize;
+  s->box = sqrt(psize);
+  s->words = (psize + 63) / 64;
+  s->row_used = (uint64_t *)mem;
+  s->col_used = s->row_used + (size_t)psize * s->words;
+  s->box_used = s->col_used + (size_t)psize * s->words;
+  s->cells = (uint16_t *)(s->box_used + (size_t)psize * s->words);
+  s->trace = NULL;
+}
+
+/**
+ * @brief Appends a step to a trace, doubling its buffer when full.
+ */
+void trace_push(solve_trace *t, size_t cell, int digit, int rule) {
+  if (t->len == t->cap) {
+    size_t cap = t->cap > 0 ? 2 * t->cap : 1024;
+    trace_step *steps =
+        t->failed ? NULL
+                  : (trace_step *)realloc(t->steps, cap * sizeof(trace_step));
+    if (steps == NULL) {
+      t->failed = true;
+      return;
+    }
+    t->steps = steps;
+    t->cap = cap;
+  }
+  int pass = rule < TRACE_GUESS ? (t->pass < 255 ? t->pass : 255) : 0;
+  t->steps[t->len++] = (trace_step){(uint32_t)cell, (uint16_t)digit,
+                                    (uint8_t)rule, (uint8_t)pass};
+}
+
+/**
+ * @brief Zobrist key of value v in cell.
+ * @details Computed with the splitmix64 finalizer rather than looked up: a
+ * table would need psize^3 keys, 128MB for a 256x256 board.
+ */
+uint64_t zobrist_key(int cell, int v) {
+  uint64_t x = ((uint64_t)cell << 16 | (uint64_t)v) + 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Places value v in an empty cell and marks it used in its units.
+ */
+void search_assign(search_state *s, int cell, int v) {
+  int r = cell / s->psize, c = cell % s->psize;
+  int b = (r / s->box) * s->box + c / s->box;
+  uint64_t bit = 1ULL << ((v - 1) & 63);
+  int w = (v - 1) >> 6;
+  s->row_used[r * s->words + w] |= bit;
+  s->col_used[c * s->words + w] |= bit;
+  s->box_used[b * s->words + w] |= bit;
+  s->cells[cell] = v;
+  s->hash ^= zobrist_key(cell, v);
+  s->empty--;
+}
+
+/**
+ * @brief Empties an assigned cell and clears its value in its units.
+ */
+void search_unassign(search_state *s, int cell) {
+  int v = s->cells[cell];
+  int r = cell / s->psize, c = cell % s->psize;
+  int b = (r / s->box) * s->box + c / s->box;
+  uint64_t bit = ~(1ULL << ((v - 1) & 63));
+  int w = (v - 1) >> 6;
+  s->row_used[r * s->words + w] &= bit;
+  s->col_used[c * s->words + w] &= bit;
+  s->box_used[b * s->words + w] &= bit;
+  s->cells[cell] = 0;
+  s->hash ^= zobrist_key(cell, v);
+  s->empty++;
+}
+
+/**
+ * @brief Loads a puzzle into a bound state.
+ * @return false if a clue is out of range or repeats in a unit.
+ */
+bool search_state_load(search_state *s, int **grid) {
+  int psize = s->psize;
+  memset(s->row_used, 0, 3 * (size_t)psize * s->words * sizeof(uint64_t));
+  memset(s->cells, 0, (size_t)psize * psize * sizeof(uint16_t));
+  s->empty = psize * psize;
+  s->hash = 0;
+  for (int r = 0; r < psize; r++) {
+    for (int c = 0; c < psize; c++) {
+      int v = grid[r + 1][c + 1];
+      if (v == 0) { continue; }
+      if (v < 0 || v > psize) { return false; }
+      int b = (r / s->box) * s->box + c / s->box;
+      uint64_t bit = 1ULL << ((v - 1) & 63);
+      int w = (v - 1) >> 6;
+      if ((s->row_used[r * s->words + w] | s->col_used[c * s->words + w] |
+           s->box_used[b * s->words + w]) & bit) {
+        return false;
+      }
+      search_assign(s, r * psize + c, v);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Computes the candidate bitset of a cell.
+ * @param out s->words words.
+ * @return The number of candidates.
+ */
+int search_candidates(const search_state *s, int cell, uint64_t *out) {
+  int r = cell / s->psize, c = cell % s->psize;
+  int b = (r / s->box) * s->box + c / s->box;
+  const uint64_t *ru = s->row_used + r * s->words;
+  const uint64_t *cu = s->col_used + c * s->words;
+  const uint64_t *bu = s->box_used + b * s->words;
+  int count = 0;
+  for (int w = 0; w < s->words; w++) {
+    int bits = s->psize - 64 * w;
+    uint64_t full = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+    out[w] = ~(ru[w] | cu[w] | bu[w]) & full;
+    count += __builtin_popcountll(out[w]);
+  }
+  return count;
+}
+
+/*
+ * The hidden-single pass needs, for every unit, the values that are a
+ * candidate in at least one and in at least two of its empty cells. Rather
+ * than computing the candidates of each cell three times (once per unit
+ * kind), search_sweep_row computes a whole row of candidates at once and the
+ * pass folds it into the tallies of the row, the columns and the subgrids in
+ * one go. For each subgrid the row has one combined row | box mask, so the
+ * sweep's inner loop only loads the column masks of the subgrid's columns
+ * (contiguous in col_used) and ORs the combined mask in, two 64-bit words
+ * per SSE2 vector. Only one row of candidates exists at a time, so it stays
+ * in L1 cache; a full candidate grid would be 2MB on a 256x256 board.
+ */
+
+// Per-task scratch for the hidden-single pass
+typedef struct {
+  uint64_t *row;    // One row of candidates, psize * words
+  uint64_t *once;   // 3 * psize unit bitsets (rows, columns, subgrids) of
+  uint64_t *twice;  // values fitting at least one / two of the unit's cells
+} sweep_scratch;
+
+/**
+ * @brief Allocates the sweep scratch for a board size from an arena.
+ * @return false if out of memory.
+ */
+bool sweep_scratch_init(sweep_scratch *sc, arena *a, int psize) {
+  size_t n = (size_t)psize * ((psize + 63) / 64);
+  sc->row = (uint64_t *)arena_alloc(a, 7 * n * sizeof(uint64_t));
+  sc->once = sc->row + n;
+  sc->twice = sc->once + 3 * n;
+  return sc->row != NULL;
+}
+
+/**
+ * @brief Computes the candidates of every cell of row r (0-based) into out,
+ * s->words words per cell. Filled cells get the candidates they would have
+ * if empty.
+ */
+void search_sweep_row(const search_state *s, int r, uint64_t *out) {
+  int psize = s->psize, box = s->box, words = s->words;
+  int last_bits = psize - 64 * (words - 1);
+  uint64_t last_full = last_bits >= 64 ? ~0ULL : (1ULL << last_bits) - 1;
+  uint64_t rowbox[words];
+  const uint64_t *ru = s->row_used + (size_t)r * words;
+  const uint64_t *band = s->box_used + (size_t)(r / box) * box * words;
+  for (int bi = 0; bi < box; bi++) {
+    for (int w = 0; w < words; w++) { rowbox[w] = ru[w] | band[bi * words + w]; }
+    rowbox[words - 1] |= ~last_full; // Values past psize are never candidates
+    const uint64_t *cu = s->col_used + (size_t)bi * box * words;
+    uint64_t *o = out + (size_t)bi * box * words;
+    int n = box * words; // The subgrid's columns, word by word
+    int k = 0;
+#ifdef __SSE2__
+    // rowbox repeats every words words; with one word or an even number a
+    // vector always covers the same pair of it
+    __m128i ones = _mm_set1_epi32(-1);
+    if (words == 1) {
+      __m128i rb = _mm_set1_epi64x((long long)rowbox[0]);
+      for (; k + 2 <= n; k += 2) {
+        __m128i cv = _mm_loadu_si128((const __m128i *)(cu + k));
+        _mm_storeu_si128((__m128i *)(o + k),
+                         _mm_xor_si128(_mm_or_si128(rb, cv), ones));
+      }
+    } else if (words % 2 == 0) {
+      for (int j = 0; k + 2 <= n; k += 2, j = j + 2 == words ? 0 : j + 2) {
+        __m128i rb = _mm_loadu_si128((const __m128i *)(rowbox + j));
+        __m128i cv = _mm_loadu_si128((const __m128i *)(cu + k));
+        _mm_storeu_si128((__m128i *)(o + k),
+                         _mm_xor_si128(_mm_or_si128(rb, cv), ones));
+      }
+    }
+#endif
+    for (int j = k % words; k < n; k++, j = j + 1 == words ? 0 : j + 1) {
+      o[k] = ~(rowbox[j] | cu[k]);
+    }
+  }
+}
+
+/**
+ * @brief Returns the cell index of the i-th cell of a unit.
+ * @param kind 0 for rows, 1 for columns, 2 for subgrids.
+ */
+int search_unit_cell(const search_state *s, int kind, int unit, int i) {
+  switch (kind) {
+  case 0:
+    return unit * s->psize + i;
+  case 1:
+    return i * s->psize + unit;
+  default:
+    return ((unit / s->box) * s->box + i / s->box) * s->psize +
+           (unit % s->box) * s->box + i % s->box;
+  }
+}
+
+/**
+ * @brief Assigns hidden singles: values that fit in only one cell of a unit.
+ * @details The tallies are swept once, up front. Assignments made during the
+ * pass only remove candidates, so afterwards a tally may still list a value
+ * that no longer fits: a single is confirmed against the live candidates
+ * before it is assigned, and singles hidden by stale entries are found by the
+ * next pass. A contradiction found in the tallies is always real.
+ * @param sc Scratch for the board size.
+ * @param trail If not NULL, assigned cells are pushed here.
+ * @return -1 if some value fits nowhere in a unit, otherwise the number of
+ * cells assigned.
+ */
+int search_hidden_singles(search_state *s, sweep_scratch *sc, int *trail,
+                          int *trail_len, search_stats *stats) {
+  int psize = s->psize, box = s->box, words = s->words;
+  size_t n = (size_t)psize * words;
+  uint64_t cand[words];
+  memset(sc->once, 0, 3 * n * sizeof(uint64_t));
+  memset(sc->twice, 0, 3 * n * sizeof(uint64_t));
+  for (int r = 0; r < psize; r++) {
+    search_sweep_row(s, r, sc->row);
+    for (int c = 0; c < psize; c++) {
+      if (s->cells[r * psize + c] != 0) { continue; }
+      const uint64_t *cd = sc->row + (size_t)c * words;
+      int units[3] = {r, psize + c, 2 * psize + (r / box) * box + c / box};
+      for (int k = 0; k < 3; k++) {
+        uint64_t *once = sc->once + (size_t)units[k] * words;
+        uint64_t *twice = sc->twice + (size_t)units[k] * words;
+        for (int w = 0; w < words; w++) {
+          twice[w] |= once[w] & cd[w];
+          once[w] |= cd[w];
+        }
+      }
+    }
+  }
+  int assigned = 0;
+  for (int kind = 0; kind < 3; kind++) {
+    const uint64_t *used_all =
+        kind == 0 ? s->row_used : kind == 1 ? s->col_used : s->box_used;
+    for (int unit = 0; unit < psize; unit++) {
+      const uint64_t *once = sc->once + ((size_t)kind * psize + unit) * words;
+      const uint64_t *twice = sc->twice + ((size_t)kind * psize + unit) * words;
+      // Values assigned earlier in this pass are now in used, not in once
+      const uint64_t *used = used_all + unit * words;
+      for (int w = 0; w < words; w++) {
+        int bits = psize - 64 * w;
+        uint64_t full = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+        if ((once[w] | used[w]) != full) { return -1; }
+        uint64_t hidden = once[w] & ~twice[w] & ~used[w];
+        for (; hidden != 0; hidden &= hidden - 1) {
+          int v = 64 * w + __builtin_ctzll(hidden) + 1;
+          int i = 0;
+          for (; i < psize; i++) {
+            int cell = search_unit_cell(s, kind, unit, i);
+            if (s->cells[cell] != 0) { continue; }
+            search_candidates(s, cell, cand);
+            if (cand[w] & (hidden & -hidden)) {
+              search_assign(s, cell, v);
+              if (trail != NULL) { trail[(*trail_len)++] = cell; }
+              if (s->trace != NULL) {
+                trace_push(s->trace, cell, v, TRACE_HIDDEN_ROW + kind);
+              }
+              stats->propagations++;
+              assigned++;
+              break;
+            }
+          }
+          if (i == psize) { return -1; } // v no longer fits anywhere
+        }
+      }
+    }
+  }
+  return assigned;
+}
+
+/**
+ * @brief Assigns naked and hidden singles until there are none left.
+ * @param sc Scratch for the hidden-single pass.
+ * @param trail If not NULL, assigned cells are pushed here; required when
+ * s->trace is set.
+ * @param trail_len Length of trail, updated.
+ * @param best_cell Output: the empty cell with the fewest candidates.
+ * @return -1 if the state is contradictory, 0 if the board is full, 1 if
+ * branching is needed.
+ */
+int search_propagate(search_state *s, sweep_scratch *sc, int *trail,
+                     int *trail_len, search_stats *stats, int *best_cell) {
+  uint64_t cand[s->words];
+  int ncells = s->psize * s->psize;
+  bool changed = true;
+  if (s->trace != NULL) { s->trace->pass = 0; }
+  while (changed && s->empty > 0) {
+    changed = false;
+    int best_count = s->psize + 1;
+    if (s->trace != NULL) { s->trace->pass++; }
+    int pass_start = *trail_len;
+    bool dead_end = false;
+    for (int cell = 0; cell < ncells; cell++) {
+      if (s->cells[cell] != 0) { continue; }
+      int count = search_candidates(s, cell, cand);
+      if (count == 0) {
+        dead_end = true;
+        break;
+      }
+      if (count == 1) {
+        int w = 0;
+        while (cand[w] == 0) { w++; }
+        int v = 64 * w + __builtin_ctzll(cand[w]) + 1;
+        search_assign(s, cell, v);
+        if (trail != NULL) { trail[(*trail_len)++] = cell; }
+        stats->propagations++;
+        changed = true;
+      } else if (count < best_count) {
+        best_count = count;
+        *best_cell = cell;
+      }
+    }
+    for (int i = pass_start; s->trace != NULL && i < *trail_len; i++) {
+      trace_push(s->trace, trail[i], s->cells[trail[i]], TRACE_NAKED);
+    }
+    if (dead_end) { return -1; }
+    if (!changed && s->empty > 0) {
+      int hidden = search_hidden_singles(s, sc, trail, trail_len, stats);
+      if (hidden < 0) { return -1; }
+      changed = hidden > 0;
+    }
+  }
+  return s->empty == 0 ? 0 : 1;
+}
+
+// One level of the explicit search stack
+typedef struct {
+  arena_mark mark;     // Arena top before this frame was allocated
+  int cell;            // Cell branched on
+  int trail_len;       // Trail length when the frame was pushed
+  int empty;           // Empty cells when the frame was pushed
+  uint64_t hash;       // State hash when the frame was pushed
+  uint64_t key;        // Hash of the branch that led here; 0 at the root
+  size_t trace_len;    // Trace length when the frame was pushed
+  uint64_t *remaining; // Values not tried yet
+  void *snapshot;      // SEARCH_COPY/COMPACT: the state before branching
+} search_frame;
+
+// State shared by the tasks of one solvePuzzleSearch call
+typedef struct {
+  int psize;
+  int **grid;           // Input puzzle; the solution is written here
+  search_state start;   // The puzzle, loaded once before the tasks start
+                        // (tasks copy it: grid may be written meanwhile)
+  bool loaded;          // The clues fit (start is valid)
+  search_options opts;
+  int num_tasks;
+  int stop;             // Set once a task has found a solution
+  int solved;
+  int failed;           // A task ran out of memory
+  int gave_up;          // A task reached opts.max_nodes
+  pthread_mutex_t lock;
+  search_stats stats;   // Sum over tasks
+  uint64_t *tt;         // Transposition table of dead-end hashes, or NULL
+  uint64_t tt_mask;     // Entries - 1
+} search_shared;
+
+/*
+ * The transposition table is direct-mapped: the low bits of a hash pick the
+ * entry and the entry holds the whole hash, so a hit is a 64-bit match.
+ * Entries are written with single atomic stores and a newer dead end simply
+ * replaces an older one, so no locks are needed. Stored states are only
+ * ever dead ends, so an overwritten entry only costs work. A hit is trusted
+ * without comparing the boards, though: a live state whose hash equals a
+ * stored dead end's is pruned, and a solvable puzzle can then be reported
+ * unsolved. Each probe compares one entry, so this takes a 64-bit
+ * collision, about one chance in 2^64 per probe.
+ */
+
+/**
+ * @brief Returns true if hash is a recorded dead end.
+ */
+bool search_tt_probe(search_shared *sh, uint64_t hash, search_stats *stats) {
+  if (sh->tt == NULL) { return false; }
+  stats->tt_probes++;
+  bool hit = __atomic_load_n(&sh->tt[hash & sh->tt_mask], __ATOMIC_RELAXED) ==
+             hash;
+  stats->tt_hits += hit;
+  return hit;
+}
+
+/**
+ * @brief Records hash as a dead end.
+ */
+void search_tt_store(search_shared *sh, uint64_t hash, search_stats *stats) {
+  if (sh->tt == NULL || hash == 0) { return; }
+  __atomic_store_n(&sh->tt[hash & sh->tt_mask], hash, __ATOMIC_RELAXED);
+  stats->tt_stores++;
+}
+
+typedef struct {
+  search_shared *shared;
+  int task;             // This task takes root values task, task + n, ...
+  int *free_cells;      // SEARCH_COMPACT: cells empty in the puzzle
+  int num_free;
+} search_task;
+
+/**
+ * @brief Bytes of one snapshot in the given mode (0 for SEARCH_TRAIL).
+ */
+size_t search_snapshot_bytes(int psize, int mode, int num_free) {
+  if (mode == SEARCH_COPY) { return search_state_bytes(psize); }
+  if (mode == SEARCH_COMPACT) { return num_free * (psize < 256 ? 1 : 2); }
+  return 0;
+}
+
+/**
+ * @brief Saves the state into a snapshot of the given mode.
+ */
+void search_save(const search_state *s, int mode, const search_task *t,
+                 void *snapshot) {
+  if (mode == SEARCH_COPY) {
+    memcpy(snapshot, s->row_used, search_state_bytes(s->psize));
+  } else if (s->psize < 256) {
+    for (int j = 0; j < t->num_free; j++) {
+      ((uint8_t *)snapshot)[j] = s->cells[t->free_cells[j]];
+    }
+  } else {
+    for (int j = 0; j < t->num_free; j++) {
+      ((uint16_t *)snapshot)[j] = s->cells[t->free_cells[j]];
+    }
+  }
+}
+
+/**
+ * @brief Restores the state from a snapshot of the given mode.
+ * @details Compact snapshots are applied cell by cell, only touching the
+ * cells that differ.
+ * @param empty Empty cell count saved with the snapshot.
+ * @param hash State hash saved with the snapshot.
+ */
+void search_restore(search_state *s, int mode, const search_task *t,
+                    const void *snapshot, int empty, uint64_t hash) {
+  if (mode == SEARCH_COPY) {
+    memcpy(s->row_used, snapshot, search_state_bytes(s->psize));
+    s->empty = empty;
+    s->hash = hash;
+    return;
+  }
+  for (int j = 0; j < t->num_free; j++) {
+    int cell = t->free_cells[j];
+    int want = s->psize < 256 ? ((const uint8_t *)snapshot)[j]
+                              : ((const uint16_t *)snapshot)[j];
+    if (s->cells[cell] == want) { continue; }
+    if (s->cells[cell] != 0) { search_unassign(s, cell); }
+    if (want != 0) { search_assign(s, cell, want); }
+  }
+}
+
+/**
+ * @brief Pushes a frame branching on cell, with its candidates filtered to
+ * the values this task owns when at the root.
+ * @param key Hash of the branch that led to this state, recorded as a dead
+ * end if the frame is exhausted; 0 at the root, whose candidates may be
+ * shared out between tasks.
+ * @return The frame, or NULL if out of memory.
+ */
+search_frame *search_push(arena *a, search_state *s, int cell, int trail_len,
+                          int mode, const search_task *t, uint64_t key) {
+  arena_mark mark = arena_get_mark(a);
+  search_frame *f = (search_frame *)arena_alloc(a, sizeof(search_frame));
+  uint64_t *remaining =
+      f ? (uint64_t *)arena_alloc(a, s->words * sizeof(uint64_t)) : NULL;
+  size_t snapshot_bytes = search_snapshot_bytes(s->psize, mode, t->num_free);
+  void *snapshot = NULL;
+  if (remaining != NULL && mode != SEARCH_TRAIL) {
+    snapshot = arena_alloc(a, snapshot_bytes > 0 ? snapshot_bytes : 1);
+  }
+  if (remaining == NULL || (mode != SEARCH_TRAIL && snapshot == NULL)) {
+    arena_release(a, mark);
+    return NULL;
+  }
+  f->mark = mark;
+  f->cell = cell;
+  f->trail_len = trail_len;
+  f->empty = s->empty;
+  f->hash = s->hash;
+  f->key = key;
+  f->trace_len = s->trace != NULL ? s->trace->len : 0;
+  f->remaining = remaining;
+  f->snapshot = snapshot;
+  search_candidates(s, cell, remaining);
+  if (key == 0 && t->shared->num_tasks > 1) {
+    // Keep every num_tasks-th candidate, starting at the task's index
+    int k = 0;
+    for (int w = 0; w < s->words; w++) {
+      for (uint64_t m = remaining[w]; m != 0; m &= m - 1, k++) {
+        if (k % t->shared->num_tasks != t->task) {
+          remaining[w] &= ~(m & -m);
+        }
+      }
+    }
+  }
+  if (snapshot != NULL) { search_save(s, mode, t, snapshot); }
+  return f;
+}
+
+/**
+ * @brief Thread entry point: depth-first search over this task's share of
+ * the root branches.
+ * @param arg A search_task.
+ */
+void *search_task_run(void *arg) {
+  search_task *t = (search_task *)arg;
+  search_shared *sh = t->shared;
+  int psize = sh->psize;
+  int mode = sh->opts.mode;
+  search_stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  arena a;
+  arena_init(&a, 256 * 1024, psize >= HUGE_PAGE_MIN_PSIZE);
+
+  size_t depth = 0;
+  search_frame **stack = NULL;
+  search_state s;
+  void *mem = arena_alloc(&a, search_state_bytes(psize));
+  int *trail = NULL;
+  if (mem != NULL && (mode == SEARCH_TRAIL || sh->opts.trace != NULL)) {
+    trail = (int *)arena_alloc(&a, (size_t)psize * psize * sizeof(int));
+  }
+  if (mem != NULL) {
+    stack = (search_frame **)arena_alloc(&a, ((size_t)psize * psize + 1) *
+                                                 sizeof(search_frame *));
+  }
+  sweep_scratch sc;
+  bool have_sc = stack != NULL && sweep_scratch_init(&sc, &a, psize);
+  int trail_len = 0;
+  int result = -1; // -1 exhausted, 0 solved, 1 out of memory, 2 node limit
+  if (mem == NULL || !have_sc ||
+      ((mode == SEARCH_TRAIL || sh->opts.trace != NULL) && trail == NULL)) {
+    result = 1;
+  } else {
+    search_state_bind(&s, psize, mem);
+    s.trace = sh->opts.trace;
+    int cell = 0;
+    bool loaded = sh->loaded;
+    if (loaded) {
+      memcpy(mem, sh->start.row_used, search_state_bytes(psize));
+      s.empty = sh->start.empty;
+      s.hash = sh->start.hash;
+    }
+    if (loaded && mode == SEARCH_COMPACT) {
+      t->free_cells = (int *)arena_alloc(&a, (s.empty + 1) * sizeof(int));
+      t->num_free = 0;
+      for (int i = 0; t->free_cells != NULL && i < psize * psize; i++) {
+        if (s.cells[i] == 0) { t->free_cells[t->num_free++] = i; }
+      }
+    }
+    int r = loaded ? search_propagate(&s, &sc, trail, &trail_len, &stats,
+                                      &cell)
+                   : -1;
+    if (loaded && mode == SEARCH_COMPACT && t->free_cells == NULL) {
+      result = 1;
+    } else if (r == 0) {
+      result = t->task == 0 ? 0 : -1; // Only one task reports a full board
+    } else if (r == 1) {
+      stack[depth] = search_push(&a, &s, cell, trail_len, mode, t, 0);
+      if (stack[depth] == NULL) {
+        result = 1;
+      } else {
+        depth++;
+      }
+    }
+  }
+
+  while (depth > 0 && result == -1) {
+    if (__atomic_load_n(&sh->stop, __ATOMIC_RELAXED)) { break; }
+    search_frame *f = stack[depth - 1];
+    int w = 0;
+    while (w < s.words && f->remaining[w] == 0) { w++; }
+    if (w == s.words) {
+      // Exhausted: the state is restored by the parent before its next try
+      if (f->key != 0) { search_tt_store(sh, f->key, &stats); }
+      depth--;
+      stats.backtracks++;
+      arena_release(&a, f->mark);
+      continue;
+    }
+    int v = 64 * w + __builtin_ctzll(f->remaining[w]) + 1;
+    f->remaining[w] &= f->remaining[w] - 1;
+    // Restore the state from before this frame's first try
+    if (mode != SEARCH_TRAIL) {
+      search_restore(&s, mode, t, f->snapshot, f->empty, f->hash);
+      trail_len = f->trail_len;  // Only a traced search keeps one here
+    } else {
+      while (trail_len > f->trail_len) {
+        search_unassign(&s, trail[--trail_len]);
+      }
+    }
+    if (s.trace != NULL && s.trace->len > f->trace_len) {
+      trace_push(s.trace, f->trace_len, 0, TRACE_BACKTRACK);
+    }
+    if (sh->opts.max_nodes > 0 && stats.nodes == sh->opts.max_nodes) {
+      result = 2;
+      break;
+    }
+    stats.nodes++;
+    search_assign(&s, f->cell, v);
+    if (trail != NULL) { trail[trail_len++] = f->cell; }
+    if (s.trace != NULL) { trace_push(s.trace, f->cell, v, TRACE_GUESS); }
+    // Propagation is deterministic, so the hash before it identifies the node
+    uint64_t key = s.hash;
+    if (search_tt_probe(sh, key, &stats)) { continue; }
+    int cell = 0;
+    int r = search_propagate(&s, &sc, trail, &trail_len, &stats, &cell);
+    if (r == 0) {
+      result = 0;
+    } else if (r < 0) {
+      search_tt_store(sh, key, &stats);
+    } else {
+      stack[depth] = search_push(&a, &s, cell, trail_len, mode, t, key);
+      if (stack[depth] == NULL) {
+        result = 1;
+      } else {
+        depth++;
+      }
+    }
+  }
+
+  pthread_mutex_lock(&sh->lock);
+  if (result == 0 && !sh->solved) {
+    sh->solved = 1;
+    __atomic_store_n(&sh->stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < psize * psize; i++) {
+      sh->grid[i / psize + 1][i % psize + 1] = s.cells[i];
+    }
+  }
+  if (result == 1) { sh->failed = 1; }
+  if (result == 2) { sh->gave_up = 1; }
+  sh->stats.nodes += stats.nodes;
+  sh->stats.backtracks += stats.backtracks;
+  sh->stats.propagations += stats.propagations;
+  sh->stats.tt_probes += stats.tt_probes;
+  sh->stats.tt_hits += stats.tt_hits;
+  sh->stats.tt_stores += stats.tt_stores;
+  pthread_mutex_unlock(&sh->lock);
+
+  arena_destroy(&a);
+  return NULL;
+}
+
+/**
+ * @brief Default search options for a board size.
+ * @details Boards below 16x16 solve faster than threads start, so they use
+ * one task; larger ones use one task per online CPU. The transposition
+ * table has 64K entries (512KB) below 16x16 and 1M (8MB) from there on.
+ */
+search_options search_default_options(int psize) {
+  search_options o;
+  o.threads = psize < 16 ? 1 : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (o.threads < 1) { o.threads = 1; }
+  o.mode = SEARCH_COPY;
+  o.tt_bits = psize < 16 ? 16 : 20;
+  o.max_nodes = 0;
+  o.trace = NULL;
+  const tune_entry *tune = tune_lookup(psize);
+  if (tune != NULL) { o.threads = tune->search_threads; }
+  return o;
+}
+
+/**
+ * @brief Runs one search with fixed options.
+ * @param tt Transposition table with tt_mask + 1 entries, or NULL.
+ * @return SEARCH_SOLVED, SEARCH_NO_SOLUTION, SEARCH_OUT_OF_MEMORY or
+ * SEARCH_NODE_LIMIT.
+ */
+int search_attempt(int psize, int **grid, const search_options *opts,
+                   uint64_t *tt, uint64_t tt_mask, search_stats *stats) {
+  search_shared sh;
+  memset(&sh, 0, sizeof(sh));
+  sh.psize = psize;
+  sh.grid = grid;
+  sh.opts = *opts;
+  sh.num_tasks = opts->threads < 1 ? 1 : opts->threads;
+  if (opts->trace != NULL) {
+    sh.num_tasks = 1;
+    opts->trace->len = 0;  // A restart records the solve afresh
+    opts->trace->failed = false;
+  }
+  sh.tt = tt;
+  sh.tt_mask = tt_mask;
+  void *start = hugeAlloc(search_state_bytes(psize), false);
+  if (start == NULL) { return SEARCH_OUT_OF_MEMORY; }
+  search_state_bind(&sh.start, psize, start);
+  sh.loaded = search_state_load(&sh.start, grid);
+  pthread_mutex_init(&sh.lock, NULL);
+  search_task tasks[sh.num_tasks];
+  pthread_t threads[sh.num_tasks];
+  for (int i = 0; i < sh.num_tasks; i++) {
+    tasks[i].shared = &sh;
+    tasks[i].task = i;
+    tasks[i].free_cells = NULL;
+    tasks[i].num_free = 0;
+  }
+  if (sh.num_tasks == 1) {
+    search_task_run(&tasks[0]);
+  } else {
+    for (int i = 0; i < sh.num_tasks; i++) {
+      pthread_create(&threads[i], NULL, search_task_run, &tasks[i]);
+    }
+    for (int i = 0; i < sh.num_tasks; i++) { pthread_join(threads[i], NULL); }
+  }
+  pthread_mutex_destroy(&sh.lock);
+  hugeFree(start);
+  stats->nodes += sh.stats.nodes;
+  stats->backtracks += sh.stats.backtracks;
+  stats->propagations += sh.stats.propagations;
+  stats->tt_probes += sh.stats.tt_probes;
+  stats->tt_hits += sh.stats.tt_hits;
+  stats->tt_stores += sh.stats.tt_stores;
+  stats->threads = sh.num_tasks;
+  stats->mode = opts->mode;
+  if (sh.solved) { return SEARCH_SOLVED; }
+  // A task that ran out of memory left its share of the tree unexplored
+  if (sh.failed) { return SEARCH_OUT_OF_MEMORY; }
+  return sh.gave_up ? SEARCH_NODE_LIMIT : SEARCH_NO_SOLUTION;
+}
+
+/**
+ * @brief Solves a puzzle by propagation and backtracking.
+ * @details The branches at the first branch point are split over
+ * opts->threads tasks; the first task to find a solution stops the others.
+ * If the memory budget runs out, the search degrades step by step (fewer
+ * tasks, compact snapshots, trail) and restarts. Restarts share one
+ * transposition table, so refuted subtrees are not searched again. With
+ * opts->trace set, one task searches and the trace holds the steps of the
+ * last attempt.
+ * @param grid The puzzle. If a solution is found it is written here,
+ * otherwise the grid is left unchanged.
+ * @param stats If not NULL, receives the search statistics.
+ * @return SEARCH_SOLVED, SEARCH_NO_SOLUTION, SEARCH_OUT_OF_MEMORY if even
+ * the leanest search did not fit in the budget, or SEARCH_NODE_LIMIT if a
+ * task gave up at opts->max_nodes.
+ */
+int solvePuzzleSearch(int psize, int **grid, const search_options *opts,
+                      search_stats *stats) {
+  search_stats total = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  search_options o = *opts;
+  if (mem_budget > 0) {
+    // Skip attempts that cannot fit: the shared start state, and for each
+    // task at least its state, stack, sweep scratch and one arena chunk
+    size_t chunk = psize >= HUGE_PAGE_MIN_PSIZE ? HUGE_PAGE_SIZE : 256 * 1024;
+    size_t per_task = search_state_bytes(psize) + chunk +
+                      ((size_t)psize * psize + 1) * sizeof(void *) +
+                      7 * (size_t)psize * ((psize + 63) / 64) *
+                          sizeof(uint64_t);
+    size_t in_use = __atomic_load_n(&mem_in_use, __ATOMIC_RELAXED);
+    in_use += search_state_bytes(psize);
+    size_t left = mem_budget > in_use ? mem_budget - in_use : 0;
+    while (o.threads > 1 && o.threads * per_task > left) {
+      o.threads /= 2;
+      total.degradations++;
+    }
+    // The table may take a quarter of what the tasks leave
+    left = left > o.threads * per_task ? left - o.threads * per_task : 0;
+    while (o.tt_bits > 0 && (sizeof(uint64_t) << o.tt_bits) > left / 4) {
+      o.tt_bits--;
+    }
+  }
+  // Without room for the table the search just runs without one
+  uint64_t tt_mask = o.tt_bits > 0 ? (1ULL << o.tt_bits) - 1 : 0;
+  uint64_t *tt = o.tt_bits > 0 ? (uint64_t *)hugeAlloc(
+                                     (tt_mask + 1) * sizeof(uint64_t),
+                                     psize >= HUGE_PAGE_MIN_PSIZE)
+                               : NULL;
+  int status;
+  while ((status = search_attempt(psize, grid, &o, tt, tt_mask, &total)) ==
+         SEARCH_OUT_OF_MEMORY) {
+    if (o.threads > 1) {
+      o.threads /= 2;
+    } else if (o.mode == SEARCH_COPY) {
+      o.mode = SEARCH_COMPACT;
+    } else if (o.mode == SEARCH_COMPACT) {
+      o.mode = SEARCH_TRAIL;
+    } else {
+      break;
+    }
+    total.degradations++;
+  }
+  if (tt != NULL) { hugeFree(tt); }
+  if (stats != NULL) { *stats = total; }
+  return status;
+}
+
+/**
+ * @brief Prints search statistics (for --stats).
+ */
+void printSearchStats(const search_stats *st) {
+  printf("Search: %ld nodes, %ld backtracks, %ld propagated, %d task(s), "
+         "%s snapshots, %d degradation(s)\n",
+         st->nodes, st->backtracks, st->propagations, st->threads,
+         search_mode_names[st->mode], st->degradations);
+  if (st->tt_probes > 0) {
+    printf("Transposition table: %ld probes, %ld hits (%.2f%%), %ld dead "
+           "ends stored\n",
+           st->tt_probes, st->tt_hits, 100.0 * st->tt_hits / st->tt_probes,
+           st->tt_stores);
+  }
+}
+
+// --- Template Engine (9x9) ---
+
+/*
+ * On a 9x9 board the cells holding any one digit form a template: one cell
+ * per row, column and subgrid. There are 46,656 of them. The template engine
+ * solves a puzzle as nine template choices, one per digit, that do not
+ * overlap:
+ *
+ * 1. Filter: each digit keeps the templates that cover all of its clues and
+ *    no clue of another digit.
+ * 2. Prune: a template of digit d is dropped if some other digit has no
+ *    template disjoint from it. Rounds repeat until nothing is dropped.
+ * 3. Search: pick the digit with the fewest templates disjoint from those
+ *    already chosen, try each of them, and give up on a branch as soon as a
+ *    cell can no longer be covered by any remaining digit.
+ *
+ * Templates are 81-bit cell sets in two 64-bit words. Filtering and each
+ * pruning round run one digit per thread.
+ */
+
+#define NUM_TEMPLATES 46656
+// Pairs of lists larger than this are not pruned against each other; the
+// check would cost more than the search it saves (only nearly empty boards)
+#define TEMPLATE_PRUNE_LIMIT (1L << 26)
+
+typedef struct {
+  uint64_t w[2]; // Bit r * 9 + c for cell (r + 1, c + 1)
+} cell_set;
+
+typedef struct {
+  int threads; // Digits are dealt out round-robin to this many threads
+} template_options;
+
+typedef struct {
+  long filtered;     // Templates left after filtering, all digits
+  long pruned;       // Templates left after pruning, all digits
+  int prune_rounds;  // Pruning rounds until no template was dropped
+  long nodes;        // Templates tried in the search
+  int threads;       // Threads used for filtering and pruning
+} template_stats;
+
+cell_set *template_table;
+pthread_once_t template_table_once = PTHREAD_ONCE_INIT;
+
+bool cell_set_disjoint(const cell_set *a, const cell_set *b) {
+  return ((a->w[0] & b->w[0]) | (a->w[1] & b->w[1])) == 0;
+}
+
+void cell_set_add(cell_set *s, int cell) { s->w[cell >> 6] |= 1ULL << (cell & 63); }
+
+/**
+ * @brief Fills template_table by placing a digit row by row in every column
+ * whose column and subgrid are still free; leaves it NULL if out of memory.
+ */
+void template_build_table(void) {
+  template_table = (cell_set *)malloc(NUM_TEMPLATES * sizeof(cell_set));
+  if (template_table == NULL) { return; }
+  int col_of[9];
+  int count = 0;
+  int r = 0;
+  col_of[0] = -1;
+  while (r >= 0) {
+    // Advance row r to its next column that clashes with no earlier row
+    int c = col_of[r] + 1;
+    for (; c < 9; c++) {
+      bool ok = true;
+      for (int i = 0; i < r && ok; i++) {
+        ok = col_of[i] != c && !(i / 3 == r / 3 && col_of[i] / 3 == c / 3);
+      }
+      if (ok) { break; }
+    }
+    col_of[r] = c;
+    if (c == 9) {
+      r--;
+    } else if (r == 8) {
+      cell_set t = {{0, 0}};
+      for (int i = 0; i < 9; i++) { cell_set_add(&t, i * 9 + col_of[i]); }
+      template_table[count++] = t;
+    } else {
+      col_of[++r] = -1;
+    }
+  }
+  assert(count == NUM_TEMPLATES);
+}
+
+typedef struct {
+  int id;
+  int threads;
+  int **grid;
+  uint16_t *lists[9];     // Template indices per digit (current)
+  int counts[9];
+  uint16_t *next[9];      // Pruning output per digit
+  int next_counts[9];
+} template_shared;
+
+typedef struct {
+  template_shared *shared;
+  int id;
+} template_task;
+
+/**
+ * @brief Thread entry point that filters the templates of every
+ * threads-th digit against the clues.
+ */
+void *template_filter_worker(void *arg) {
+  template_task *t = (template_task *)arg;
+  template_shared *sh = t->shared;
+  for (int d = t->id; d < 9; d += sh->threads) {
+    cell_set need = {{0, 0}}, avoid = {{0, 0}};
+    for (int r = 0; r < 9; r++) {
+      for (int c = 0; c < 9; c++) {
+        int v = sh->grid[r + 1][c + 1];
+        if (v == d + 1) {
+          cell_set_add(&need, r * 9 + c);
+        } else if (v != 0) {
+          cell_set_add(&avoid, r * 9 + c);
+        }
+      }
+    }
+    int n = 0;
+    for (int i = 0; i < NUM_TEMPLATES; i++) {
+      const cell_set *tp = &template_table[i];
+      if ((tp->w[0] & need.w[0]) == need.w[0] &&
+          (tp->w[1] & need.w[1]) == need.w[1] && cell_set_disjoint(tp, &avoid)) {
+        sh->lists[d][n++] = i;
+      }
+    }
+    sh->counts[d] = n;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Thread entry point for one pruning round: keeps the templates of
+ * every threads-th digit that have a disjoint partner in each other digit's
+ * list. Reads lists/counts and writes next/next_counts, so digits never see
+ * each other's partial results.
+ */
+void *template_prune_worker(void *arg) {
+  template_task *t = (template_task *)arg;
+  template_shared *sh = t->shared;
+  for (int d = t->id; d < 9; d += sh->threads) {
+    int n = 0;
+    for (int i = 0; i < sh->counts[d]; i++) {
+      const cell_set *tp = &template_table[sh->lists[d][i]];
+      bool keep = true;
+      for (int e = 0; e < 9 && keep; e++) {
+        if (e == d || (long)sh->counts[d] * sh->counts[e] > TEMPLATE_PRUNE_LIMIT) {
+          continue;
+        }
+        keep = false;
+        for (int j = 0; j < sh->counts[e] && !keep; j++) {
+          keep = cell_set_disjoint(tp, &template_table[sh->lists[e][j]]);
+        }
+      }
+      if (keep) { sh->next[d][n++] = sh->lists[d][i]; }
+    }
+    sh->next_counts[d] = n;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Runs worker once per thread, on the caller when there is one.
+ */
+void template_run_threads(template_shared *sh, void *(*worker)(void *)) {
+  template_task tasks[sh->threads];
+  pthread_t threads[sh->threads];
+  for (int i = 0; i < sh->threads; i++) {
+    tasks[i].shared = sh;
+    tasks[i].id = i;
+    if (sh->threads == 1) {
+      worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, worker, &tasks[i]);
+    }
+  }
+  for (int i = 0; sh->threads > 1 && i < sh->threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/**
+ * @brief Chooses templates for the digits not yet in chosen, depth-first.
+ * @param lists Candidate templates per digit, already disjoint from used.
+ * @param used Cells covered by the templates chosen so far.
+ * @param pick Receives the chosen template per digit.
+ * @return true if every digit got a template.
+ */
+bool template_search(uint16_t *lists[9], const int counts[9], cell_set used,
+                     int chosen, int pick[9], long *nodes) {
+  if (chosen == 0x1FF) { return true; }
+  // Branch on the digit with the fewest templates left
+  int best = -1;
+  for (int d = 0; d < 9; d++) {
+    if (!(chosen & (1 << d)) && (best < 0 || counts[d] < counts[best])) {
+      best = d;
+    }
+  }
+  uint16_t *sub[9];
+  int sub_counts[9];
+  for (int d = 0; d < 9; d++) {
+    sub[d] = (chosen & (1 << d)) || d == best
+                 ? NULL
+                 : (uint16_t *)malloc(counts[d] * sizeof(uint16_t));
+  }
+  bool found = false;
+  for (int i = 0; i < counts[best] && !found; i++) {
+    const cell_set *tp = &template_table[lists[best][i]];
+    (*nodes)++;
+    cell_set now = {{used.w[0] | tp->w[0], used.w[1] | tp->w[1]}};
+    // Keep each remaining digit's templates that fit, and check that every
+    // cell is still covered by something
+    cell_set cover = now;
+    bool dead = false;
+    for (int d = 0; d < 9 && !dead; d++) {
+      if (sub[d] == NULL) { continue; }
+      int n = 0;
+      for (int j = 0; j < counts[d]; j++) {
+        const cell_set *u = &template_table[lists[d][j]];
+        if (cell_set_disjoint(u, tp)) {
+          sub[d][n++] = lists[d][j];
+          cover.w[0] |= u->w[0];
+          cover.w[1] |= u->w[1];
+        }
+      }
+      sub_counts[d] = n;
+      dead = n == 0;
+    }
+    if (dead || cover.w[0] != ~0ULL || cover.w[1] != (1ULL << 17) - 1) {
+      continue;
+    }
+    pick[best] = lists[best][i];
+    found = template_search(sub, sub_counts, now, chosen | (1 << best), pick,
+                            nodes);
+  }
+  for (int d = 0; d < 9; d++) { free(sub[d]); }
+  return found;
+}
+
+/**
+ * @brief Default options: one thread per digit, up to the number of CPUs.
+ */
+template_options template_default_options(void) {
+  template_options o;
+  o.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (o.threads < 1) { o.threads = 1; }
+  if (o.threads > 9) { o.threads = 9; }
+  return o;
+}
+
+/**
+ * @brief Solves a 9x9 puzzle with the template engine.
+ * @param grid The puzzle. If a solution is found it is written here,
+ * otherwise the grid is left unchanged.
+ * @param stats If not NULL, receives the template statistics.
+ * @return SEARCH_SOLVED, SEARCH_NO_SOLUTION, or SEARCH_OUT_OF_MEMORY if the
+ * template table or the candidate lists could not be allocated (the grid is
+ * then unchanged).
+ */
+int solvePuzzleTemplate(int **grid, const template_options *opts,
+                        template_stats *stats) {
+  pthread_once(&template_table_once, template_build_table);
+  template_shared sh;
+  memset(&sh, 0, sizeof(sh));
+  sh.threads = opts->threads < 1 ? 1 : (opts->threads > 9 ? 9 : opts->threads);
+  sh.grid = grid;
+  bool allocated = template_table != NULL;
+  for (int d = 0; d < 9; d++) {
+    sh.lists[d] = (uint16_t *)malloc(NUM_TEMPLATES * sizeof(uint16_t));
+    sh.next[d] = (uint16_t *)malloc(NUM_TEMPLATES * sizeof(uint16_t));
+    allocated = allocated && sh.lists[d] != NULL && sh.next[d] != NULL;
+  }
+  template_stats st = {0, 0, 0, 0, sh.threads};
+  if (!allocated) {
+    for (int d = 0; d < 9; d++) {
+      free(sh.lists[d]);
+      free(sh.next[d]);
+    }
+    if (stats != NULL) { *stats = st; }
+    return SEARCH_OUT_OF_MEMORY;
+  }
+  template_run_threads(&sh, template_filter_worker);
+  for (int d = 0; d < 9; d++) { st.filtered += sh.counts[d]; }
+
+  bool changed = true;
+  while (changed) {
+    template_run_threads(&sh, template_prune_worker);
+    st.prune_rounds++;
+    changed = false;
+    for (int d = 0; d < 9; d++) {
+      changed |= sh.next_counts[d] != sh.counts[d];
+      uint16_t *t = sh.lists[d];
+      sh.lists[d] = sh.next[d];
+      sh.next[d] = t;
+      sh.counts[d] = sh.next_counts[d];
+    }
+  }
+  for (int d = 0; d < 9; d++) { st.pruned += sh.counts[d]; }
+
+  int pick[9];
+  cell_set none = {{0, 0}};
+  bool solved = template_search(sh.lists, sh.counts, none, 0, pick, &st.nodes);
+  if (solved) {
+    for (int d = 0; d < 9; d++) {
+      const cell_set *tp = &template_table[pick[d]];
+      for (int cell = 0; cell < 81; cell++) {
+        if (tp->w[cell >> 6] & (1ULL << (cell & 63))) {
+          grid[cell / 9 + 1][cell % 9 + 1] = d + 1;
+        }
+      }
+    }
+  }
+  for (int d = 0; d < 9; d++) {
+    free(sh.lists[d]);
+    free(sh.next[d]);
+  }
+  if (stats != NULL) { *stats = st; }
+  return solved ? SEARCH_SOLVED : SEARCH_NO_SOLUTION;
+}
+
+/**
+ * @brief Prints template engine statistics (for --stats).
+ */
+void printTemplateStats(const template_stats *st) {
+  printf("Templates: %ld after filtering, %ld after %d pruning round(s), "
+         "%ld tried, %d thread(s)\n",
+         st->filtered, st->pruned, st->prune_rounds, st->nodes, st->threads);
+}
+
+// --- Cold-Start Path ---
+
+/*
+ * Most callers run "./sudoku puzzle.txt" once per puzzle, so for them
+ * process start-up is a large part of the run. For boards up to
+ * COLD_MAX_PSIZE with no options, solveColdStart replaces the general path.
+ * It reads the file with one read into a static buffer, parses into a
+ * static grid whose row table is initialized at compile time, and runs the
+ * fill-in loop and the validation on the calling thread. It then formats
+ * the same output as main into a static buffer and sends it with one write.
+ * It does no malloc and creates no thread, and it never touches stdio, so
+ * stdout's buffer is not even allocated.
+ */
+
+#define COLD_MAX_PSIZE 25
+#define COLD_INPUT_BYTES (64 * 1024)
+#define COLD_OUTPUT_BYTES (16 * 1024)
+
+char cold_input[COLD_INPUT_BYTES];
+char cold_output[COLD_OUTPUT_BYTES];
+// Rows have a fixed stride, so the row table does not depend on psize
+int cold_cells[COLD_MAX_PSIZE + 1][COLD_MAX_PSIZE + 1];
+#define COLD_ROWS5(r)                                                          \
+  cold_cells[r], cold_cells[r + 1], cold_cells[r + 2], cold_cells[r + 3],      \
+      cold_cells[r + 4]
+int *cold_rows[COLD_MAX_PSIZE + 1] = {
+    COLD_ROWS5(0), COLD_ROWS5(5), COLD_ROWS5(10), COLD_ROWS5(15),
+    COLD_ROWS5(20), cold_cells[25]};
+// "00" to "99", two bytes per value
+const char cold_digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
+/**
+ * @brief Appends v and a space (printf's "%d ") two digits at a time.
+ * @return The end of the appended text.
+ */
+char *cold_format_int(char *out, int v) {
+  char tmp[12];
+  char *p = tmp + sizeof(tmp);
+  unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+  while (u >= 100) {
+    p -= 2;
+    memcpy(p, cold_digit_pairs + 2 * (u % 100), 2);
+    u /= 100;
+  }
+  if (u >= 10) {
+    p -= 2;
+    memcpy(p, cold_digit_pairs + 2 * u, 2);
+  } else {
+    *--p = (char)('0' + u);
+  }
+  if (v < 0) { *--p = '-'; }
+  size_t n = tmp + sizeof(tmp) - p;
+  memcpy(out, p, n);
+  out[n] = ' ';
+  return out + n + 1;
+}
+
+/**
+ * @brief Appends a string literal's text.
+ */
+char *cold_append(char *out, const char *text) {
+  size_t n = strlen(text);
+  memcpy(out, text, n);
+  return out + n;
+}
+
+/**
+ * @brief Checks and prints a small puzzle without allocating or threading.
+ * @details Same result and output as main with the fill engine: the fill-in
+ * loop is process_unit over all units until a pass fills nothing, as in
+ * fillPuzzleThreads with one thread.
+ * @param filename The puzzle file.
+ * @return false, having printed nothing, if the puzzle is not one this path
+ * handles (unreadable, malformed, larger than COLD_MAX_PSIZE or longer than
+ * the buffer); main then takes the general path, which reports any error.
+ */
+bool solveColdStart(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return false; }
+  ssize_t len = read(fd, cold_input, sizeof(cold_input));
+  close(fd);
+  if (len < 0 || len == (ssize_t)sizeof(cold_input)) { return false; }
+  tokenizer tok = {cold_input, (size_t)len, 0};
+  int psize;
+  if (tokenizer_next(&tok, &psize) != 1 || psize < 1 ||
+      psize > COLD_MAX_PSIZE) {
+    return false;
+  }
+  int **grid = cold_rows;
+  for (int row = 1; row <= psize; row++) {
+    if (tokenizer_read_ints(&tok, &grid[row][1], psize) != psize) {
+      return false;
+    }
+  }
+
+  bool complete = isPuzzleComplete(psize, grid);
+  if (!complete) {
+    int filled;
+    do {
+      filled = 0;
+      for (int u = 0; u < 3 * psize; u++) {
+        filled += process_unit(u, psize, grid, true);
+      }
+    } while (filled > 0);
+    complete = isPuzzleComplete(psize, grid);
+  }
+  bool valid = true;
+  for (int u = 0; u < 3 * psize && valid; u++) {
+    valid = process_unit(u, psize, grid, false);
+  }
+
+  char *out = cold_output;
+  out = cold_append(out, complete ? "Complete puzzle? true\n"
+                                  : "Complete puzzle? false\n");
+  if (complete) {
+    out = cold_append(out, valid ? "Valid puzzle? true\n"
+                                 : "Valid puzzle? false\n");
+  }
+  out = cold_format_int(out, psize);
+  out[-1] = '\n';
+  for (int row = 1; row <= psize; row++) {
+    for (int col = 1; col <= psize; col++) {
+      out = cold_format_int(out, grid[row][col]);
+    }
+    *out++ = '\n';
+  }
+  *out++ = '\n';
+  for (char *p = cold_output; p < out;) {
+    ssize_t put = write(1, p, out - p);
+    if (put <= 0) { break; }
+    p += put;
+  }
+  return true;
+}
+
+// --- Game Log Audit ---
+
+/*
+ * An audit log holds one game per line: the puzzle size, the psize * psize
+ * clues (0 for empty) and then the player's moves as "row col value"
+ * triples, 1-based, where value 0 erases the cell. auditGameLogs replays
+ * every game and reports its first illegal move: one outside the board,
+ * one that writes over a clue, or one that repeats a value already in its
+ * row, column or subgrid. Each move costs a few bit operations on per-unit
+ * bitsets; the grid is never rescanned.
+ *
+ * The calling thread reads the input in blocks of whole lines and a pool of
+ * workers replays them, a block each. Up to two blocks per worker are in
+ * flight, and the reports of each block are printed in input order as soon
+ * as the blocks before it are done.
+ */
+
+#define AUDIT_BLOCK_BYTES (1 << 20)
+#define AUDIT_MAX_PSIZE 1024
+
+enum {
+  AUDIT_OK,
+  AUDIT_MALFORMED,
+  AUDIT_BAD_CLUES,
+  AUDIT_OFF_BOARD,
+  AUDIT_CLUE_OVERWRITE,
+  AUDIT_ROW_REPEAT,
+  AUDIT_COL_REPEAT,
+  AUDIT_BOX_REPEAT,
+  NUM_AUDIT_RESULTS
+};
+const char *audit_messages[NUM_AUDIT_RESULTS] = {
+    "is legal",
+    "is malformed",
+    "has conflicting clues",
+    "is off the board",
+    "overwrites a clue",
+    "repeats a value in its row",
+    "repeats a value in its column",
+    "repeats a value in its subgrid",
+};
+
+// One worker's replay board, grown to the largest size seen
+typedef struct {
+  int capacity;        // psize the arrays are sized for
+  int psize;
+  int box;
+  int words;           // 64-bit words per unit bitset
+  int *cells;          // psize * psize current values, row-major
+  bool *clue;          // psize * psize
+  uint64_t *row_used;  // psize bitsets each
+  uint64_t *col_used;
+  uint64_t *box_used;
+} audit_board;
+
+// The first illegal move of a game
+typedef struct {
+  int result;          // AUDIT_*
+  long move;           // 1-based move number, 0 if the game never started
+  int row, col, value; // The move as written
+} audit_report;
+
+/**
+ * @brief Sizes a board for psize and clears it.
+ */
+void audit_board_reset(audit_board *b, int psize) {
+  int words = (psize + 63) / 64;
+  if (psize > b->capacity) {
+    size_t cells = (size_t)psize * psize;
+    b->cells = (int *)realloc(b->cells, cells * sizeof(int));
+    b->clue = (bool *)realloc(b->clue, cells * sizeof(bool));
+    b->row_used = (uint64_t *)realloc(b->row_used,
+                                      3 * (size_t)psize * words * sizeof(uint64_t));
+    if (b->cells == NULL || b->clue == NULL || b->row_used == NULL) {
+      printf("Not enough memory to audit a %dx%d game\n", psize, psize);
+      exit(EXIT_FAILURE);
+    }
+    b->capacity = psize;
+  }
+  b->psize = psize;
+  b->box = sqrt(psize);
+  b->words = words;
+  b->col_used = b->row_used + (size_t)psize * words;
+  b->box_used = b->col_used + (size_t)psize * words;
+  memset(b->row_used, 0, 3 * (size_t)psize * words * sizeof(uint64_t));
+}
+
+/**
+ * @brief Places or erases a value, checking it against the unit bitsets.
+ * @param r, c 0-based cell.
+ * @param v The value, 0 to erase.
+ * @return AUDIT_OK or the AUDIT_* repeat that makes the move illegal; the
+ * board is unchanged then.
+ */
+int audit_place(audit_board *b, int r, int c, int v) {
+  int cell = r * b->psize + c;
+  int box = (r / b->box) * b->box + c / b->box;
+  int old = b->cells[cell];
+  if (old != 0) {
+    uint64_t clear = ~(1ULL << ((old - 1) & 63));
+    int w = (old - 1) >> 6;
+    b->row_used[r * b->words + w] &= clear;
+    b->col_used[c * b->words + w] &= clear;
+    b->box_used[box * b->words + w] &= clear;
+    b->cells[cell] = 0;
+  }
+  if (v == 0) { return AUDIT_OK; }
+  uint64_t bit = 1ULL << ((v - 1) & 63);
+  int w = (v - 1) >> 6;
+  int result = b->row_used[r * b->words + w] & bit   ? AUDIT_ROW_REPEAT
+               : b->col_used[c * b->words + w] & bit ? AUDIT_COL_REPEAT
+               : b->box_used[box * b->words + w] & bit ? AUDIT_BOX_REPEAT
+                                                       : AUDIT_OK;
+  if (result != AUDIT_OK) {
+    if (old != 0) { audit_place(b, r, c, old); }
+    return result;
+  }
+  b->row_used[r * b->words + w] |= bit;
+  b->col_used[c * b->words + w] |= bit;
+  b->box_used[box * b->words + w] |= bit;
+  b->cells[cell] = v;
+  return AUDIT_OK;
+}
+
+/**
+ * @brief Replays one game up to its first illegal move.
+ * @param line The game, without its newline.
+ * @return false if the line is blank (not a game).
+ */
+bool audit_game(audit_board *b, const char *line, size_t len,
+                audit_report *rep) {
+  tokenizer t = {line, len, 0};
+  memset(rep, 0, sizeof(*rep));
+  int psize;
+  int got = tokenizer_next(&t, &psize);
+  if (got == 0) { return false; }
+  int box = got == 1 && psize > 0 ? (int)sqrt(psize) : 0;
+  if (got < 0 || psize < 1 || psize > AUDIT_MAX_PSIZE || box * box != psize) {
+    rep->result = AUDIT_MALFORMED;
+    return true;
+  }
+  audit_board_reset(b, psize);
+  int ncells = psize * psize;
+  if (tokenizer_read_ints(&t, b->cells, ncells) != ncells) {
+    rep->result = AUDIT_MALFORMED;
+    return true;
+  }
+  for (int cell = 0; cell < ncells; cell++) {
+    int v = b->cells[cell];
+    b->clue[cell] = v != 0;
+    b->cells[cell] = 0;
+    if (v < 0 || v > psize ||
+        (v != 0 && audit_place(b, cell / psize, cell % psize, v) != AUDIT_OK)) {
+      rep->result = AUDIT_BAD_CLUES;
+      return true;
+    }
+  }
+  for (;;) {
+    int row, col, value;
+    got = tokenizer_next(&t, &row);
+    if (got == 0) { return true; }
+    rep->move++;
+    if (got < 0 || tokenizer_next(&t, &col) != 1 ||
+        tokenizer_next(&t, &value) != 1) {
+      rep->result = AUDIT_MALFORMED;
+      return true;
+    }
+    rep->row = row;
+    rep->col = col;
+    rep->value = value;
+    if (row < 1 || row > psize || col < 1 || col > psize || value < 0 ||
+        value > psize) {
+      rep->result = AUDIT_OFF_BOARD;
+    } else if (b->clue[(row - 1) * psize + col - 1]) {
+      rep->result = AUDIT_CLUE_OVERWRITE;
+    } else {
+      rep->result = audit_place(b, row - 1, col - 1, value);
+    }
+    if (rep->result != AUDIT_OK) { return true; }
+  }
+}
+
+// A block of whole lines and, once replayed, its reports
+typedef struct {
+  char *text;
+  size_t len;
+  long first_line;     // Line number of the block's first line
+  char *out;           // Report text, printed in block order
+  size_t out_len;
+  size_t out_cap;
+  long games;
+  long illegal;        // Games with an illegal move, bad clues or bad format
+  int state;           // AUDIT_SLOT_*
+} audit_block;
+
+enum { AUDIT_SLOT_FREE, AUDIT_SLOT_READY, AUDIT_SLOT_BUSY, AUDIT_SLOT_DONE };
+
+typedef struct {
+  audit_block *slots;
+  int num_slots;
+  long next_take;      // Next block a worker takes (slot = index % num_slots)
+  long filled;         // Blocks handed out by the reader so far
+  bool eof;            // The reader has handed out its last block
+  pthread_mutex_t lock;
+  pthread_cond_t ready;  // A block became READY, or eof
+  pthread_cond_t done;   // A block became DONE
+} audit_queue;
+
+/**
+ * @brief Appends a formatted report line to a block's output.
+ */
+void audit_append(audit_block *blk, const char *line, int n) {
+  if (blk->out_len + n + 1 > blk->out_cap) {
+    blk->out_cap = 2 * (blk->out_len + n + 1);
+    blk->out = (char *)realloc(blk->out, blk->out_cap);
+  }
+  memcpy(blk->out + blk->out_len, line, n);
+  blk->out_len += n;
+}
+
+/**
+ * @brief Replays every game of a block and formats the reports.
+ */
+void audit_block_run(audit_board *b, audit_block *blk) {
+  blk->out_len = 0;
+  blk->games = blk->illegal = 0;
+  long line_no = blk->first_line;
+  for (size_t pos = 0; pos < blk->len; line_no++) {
+    const char *nl = memchr(blk->text + pos, '\n', blk->len - pos);
+    size_t end = nl ? (size_t)(nl - blk->text) : blk->len;
+    audit_report rep;
+    if (audit_game(b, blk->text + pos, end - pos, &rep)) {
+      blk->games++;
+      if (rep.result != AUDIT_OK) {
+        char msg[160];
+        int n = rep.move == 0 || rep.result == AUDIT_MALFORMED
+                    ? snprintf(msg, sizeof(msg), "line %ld: game %s\n", line_no,
+                               audit_messages[rep.result])
+                    : snprintf(msg, sizeof(msg),
+                               "line %ld: move %ld (%d %d %d) %s\n", line_no,
+                               rep.move, rep.row, rep.col, rep.value,
+                               audit_messages[rep.result]);
+        audit_append(blk, msg, n);
+        blk->illegal++;
+      }
+    }
+    pos = end + 1;
+  }
+}
+
+/**
+ * @brief Worker function: replays READY blocks until the reader is done.
+ * @param arg The audit_queue.
+ * @return NULL.
+ */
+void *audit_worker(void *arg) {
+  audit_queue *q = (audit_queue *)arg;
+  audit_board board;
+  memset(&board, 0, sizeof(board));
+  pthread_mutex_lock(&q->lock);
+  for (;;) {
+    while (q->next_take == q->filled && !q->eof) {
+      pthread_cond_wait(&q->ready, &q->lock);
+    }
+    if (q->next_take == q->filled) { break; }
+    audit_block *blk = &q->slots[q->next_take++ % q->num_slots];
+    blk->state = AUDIT_SLOT_BUSY;
+    pthread_mutex_unlock(&q->lock);
+    audit_block_run(&board, blk);
+    pthread_mutex_lock(&q->lock);
+    blk->state = AUDIT_SLOT_DONE;
+    pthread_cond_broadcast(&q->done);
+  }
+  pthread_mutex_unlock(&q->lock);
+  free(board.cells);
+  free(board.clue);
+  free(board.row_used);
+  return NULL;
+}
+
+/**
+ * @brief Prints a finished block's reports and adds up its counts.
+ */
+void audit_flush(audit_block *blk, long *games, long *illegal) {
+  fwrite(blk->out, 1, blk->out_len, stdout);
+  *games += blk->games;
+  *illegal += blk->illegal;
+  blk->state = AUDIT_SLOT_FREE;
+}
+
+/**
+ * @brief Audits a stream of game logs (see the section comment).
+ * @param fd Input; read to the end.
+ * @param num_threads Workers replaying blocks.
+ * @return EXIT_SUCCESS if every game was legal, EXIT_FAILURE otherwise,
+ * including when memory ran out before the end of the input.
+ */
+int auditGameLogs(int fd, int num_threads) {
+  audit_queue q;
+  memset(&q, 0, sizeof(q));
+  q.num_slots = 2 * num_threads;
+  q.slots = (audit_block *)calloc(q.num_slots, sizeof(audit_block));
+  pthread_mutex_init(&q.lock, NULL);
+  pthread_cond_init(&q.ready, NULL);
+  pthread_cond_init(&q.done, NULL);
+  pthread_t threads[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, audit_worker, &q);
+  }
+
+  long games = 0, illegal = 0, printed = 0, line_no = 1;
+  char *carry = NULL; // Partial last line of the previous read
+  size_t carry_len = 0;
+  bool at_eof = false, out_of_memory = false;
+  while (!at_eof) {
+    audit_block *blk = &q.slots[q.filled % q.num_slots];
+    pthread_mutex_lock(&q.lock);
+    // Print finished blocks in order until the slot to fill is free
+    while (blk->state != AUDIT_SLOT_FREE) {
+      while (q.slots[printed % q.num_slots].state != AUDIT_SLOT_DONE) {
+        pthread_cond_wait(&q.done, &q.lock);
+      }
+      audit_flush(&q.slots[printed++ % q.num_slots], &games, &illegal);
+    }
+    pthread_mutex_unlock(&q.lock);
+
+    // The block keeps its text buffer between uses
+    size_t cap = AUDIT_BLOCK_BYTES > 2 * carry_len ? AUDIT_BLOCK_BYTES
+                                                   : 2 * carry_len;
+    char *text = (char *)realloc(blk->text, cap);
+    if (text == NULL) {
+      out_of_memory = true;
+      break;
+    }
+    blk->text = text;
+    if (carry_len > 0) { memcpy(blk->text, carry, carry_len); }
+    size_t len = carry_len;
+    for (;;) {
+      ssize_t got = read(fd, blk->text + len, cap - len);
+      if (got <= 0) {
+        at_eof = true;
+        break;
+      }
+      len += got;
+      if (memchr(blk->text + len - got, '\n', got) != NULL && len > cap / 2) {
+        break;
+      }
+      if (len == cap) {
+        // One line longer than the buffer: grow until it ends
+        text = (char *)realloc(blk->text, 2 * cap);
+        if (text == NULL) {
+          out_of_memory = true;
+          break;
+        }
+        blk->text = text;
+        cap *= 2;
+      }
+    }
+    if (out_of_memory) { break; }
+    // Keep the partial last line for the next block
+    size_t cut = len;
+    if (!at_eof) {
+      while (cut > 0 && blk->text[cut - 1] != '\n') { cut--; }
+    }
+    carry_len = len - cut;
+    if (carry_len > 0) {
+      text = (char *)realloc(carry, carry_len);
+      if (text == NULL) {
+        out_of_memory = true;
+        break;
+      }
+      carry = text;
+      memcpy(carry, blk->text + cut, carry_len);
+    }
+    blk->len = cut;
+    blk->first_line = line_no;
+    for (const char *p = blk->text; (p = memchr(p, '\n', blk->text + cut - p));
+         p++) {
+      line_no++;
+    }
+    pthread_mutex_lock(&q.lock);
+    blk->state = AUDIT_SLOT_READY;
+    q.filled++;
+    pthread_cond_signal(&q.ready);
+    pthread_mutex_unlock(&q.lock);
+  }
+  pthread_mutex_lock(&q.lock);
+  q.eof = true;
+  pthread_cond_broadcast(&q.ready);
+  while (printed < q.filled) {
+    while (q.slots[printed % q.num_slots].state != AUDIT_SLOT_DONE) {
+      pthread_cond_wait(&q.done, &q.lock);
+    }
+    audit_flush(&q.slots[printed++ % q.num_slots], &games, &illegal);
+  }
+  pthread_mutex_unlock(&q.lock);
+  for (int i = 0; i < num_threads; i++) { pthread_join(threads[i], NULL); }
+  printf("Audited %ld game(s): %ld with an illegal move or bad input\n", games,
+         illegal);
+  if (out_of_memory) { printf("Not enough memory to read the rest\n"); }
+
+  for (int i = 0; i < q.num_slots; i++) {
+    free(q.slots[i].text);
+    free(q.slots[i].out);
+  }
+  free(q.slots);
+  free(carry);
+  pthread_mutex_destroy(&q.lock);
+  pthread_cond_destroy(&q.ready);
+  pthread_cond_destroy(&q.done);
+  return illegal == 0 && !out_of_memory ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Entry point of --audit.
+ * @param argc Number of arguments after the mode.
+ * @param argv A log file ("-" for stdin) and an optional thread count
+ * (default: online CPUs).
+ */
+int runAudit(int argc, char **argv) {
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc < 1 || argc > 2 || num_threads < 1) {
+    printf("usage: ./sudoku --audit logs.txt|- [threads]\n");
+    return EXIT_FAILURE;
+  }
+  int fd = strcmp(argv[0], "-") == 0 ? 0 : open(argv[0], O_RDONLY);
+  if (fd < 0) {
+    printf("Could not open file %s\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int status = auditGameLogs(fd, num_threads);
+  if (fd != 0) { close(fd); }
+  return status;
+}
+
+// --- Puzzle Corpus Index ---
+
+/*
+ * A corpus is a file of puzzles, one after another, each in the puzzle file
+ * format. "--corpus-index" writes next to it an index (corpus + ".idx")
+ * that is mapped, not parsed, by the readers:
+ *
+ *   corpus_index_header
+ *   uint64_t offset[count]              byte offset of puzzle id in the corpus
+ *   uint64_t length[count]              bytes of its text
+ *   uint64_t attr[CORPUS_NUM_ATTRS][count]   size, clues, difficulty by id
+ *   uint32_t order[CORPUS_NUM_ATTRS][count]  ids sorted by each attribute
+ *
+ * Difficulty is the number of branch-point values the search engine tries,
+ * with one task (0 if propagation alone solves the puzzle), capped at
+ * CORPUS_MAX_NODES so that one pathological puzzle cannot stall indexing. A filtered
+ * sample binary searches each constrained attribute's sorted column, walks
+ * the narrowest of those ranges checking the other attributes by id, and
+ * draws the sample from the matches. Puzzles are then copied straight from
+ * the corpus at their offsets.
+ */
+
+#define CORPUS_INDEX_MAGIC "SUDOKIDX"
+#define CORPUS_INDEX_VERSION 1
+#define CORPUS_MAX_NODES 20000
+
+enum { CORPUS_SIZE, CORPUS_CLUES, CORPUS_DIFFICULTY, CORPUS_NUM_ATTRS };
+const char *corpus_attr_names[CORPUS_NUM_ATTRS] = {"size", "clues",
+                                                    "difficulty"};
+
+typedef struct {
+  char magic[8];         // CORPUS_INDEX_MAGIC
+  uint32_t version;      // CORPUS_INDEX_VERSION
+  uint32_t count;        // Puzzles in the corpus
+  uint64_t corpus_size;  // Corpus bytes when indexed, to catch stale indexes
+} corpus_index_header;
+
+// An index mapped for reading, or being built in memory
+typedef struct {
+  void *map;
+  size_t map_size;
+  const corpus_index_header *header;
+  uint32_t count;
+  uint64_t *offset;
+  uint64_t *length;
+  uint64_t *attr[CORPUS_NUM_ATTRS];
+  uint32_t *order[CORPUS_NUM_ATTRS];
+} corpus_index;
+
+/**
+ * @brief Bytes of an index of count puzzles.
+ */
+size_t corpus_index_bytes(uint32_t count) {
+  return sizeof(corpus_index_header) +
+         (2 + CORPUS_NUM_ATTRS) * (size_t)count * sizeof(uint64_t) +
+         CORPUS_NUM_ATTRS * (size_t)count * sizeof(uint32_t);
+}
+
+/**
+ * @brief Points the column pointers of an index into its bytes.
+ */
+void corpus_index_bind(corpus_index *ix, void *mem, uint32_t count) {
+  ix->header = (const corpus_index_header *)mem;
+  ix->count = count;
+  uint64_t *p = (uint64_t *)((char *)mem + sizeof(corpus_index_header));
+  ix->offset = p;
+  ix->length = p + count;
+  for (int a = 0; a < CORPUS_NUM_ATTRS; a++) {
+    ix->attr[a] = p + (size_t)(2 + a) * count;
+  }
+  uint32_t *q = (uint32_t *)(p + (size_t)(2 + CORPUS_NUM_ATTRS) * count);
+  for (int a = 0; a < CORPUS_NUM_ATTRS; a++) {
+    ix->order[a] = q + (size_t)a * count;
+  }
+}
+
+/**
+ * @brief Builds the path of a corpus's index file.
+ * @return A buffer to free.
+ */
+char *corpus_index_path(const char *corpus) {
+  size_t n = strlen(corpus);
+  char *path = (char *)malloc(n + 5);
+  memcpy(path, corpus, n);
+  memcpy(path + n, ".idx", 5);
+  return path;
+}
+
+/**
+ * @brief Maps a whole file read-only.
+ * @return The mapping (NULL for an empty file), or MAP_FAILED.
+ */
+void *map_file(const char *filename, size_t *size) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return MAP_FAILED; }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0) {
+    *size = st.st_size;
+    map = st.st_size == 0 ? NULL
+                          : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  return map;
+}
+
+// Puzzles split over the index-building threads
+typedef struct {
+  corpus_index *ix;
+  const char *text;
+  int id;
+  int num_threads;
+} corpus_task;
+
+/**
+ * @brief Worker function: counts clues and measures the difficulty of every
+ * num_threads-th puzzle.
+ * @param arg A corpus_task.
+ * @return NULL.
+ */
+void *corpus_rate_worker(void *arg) {
+  corpus_task *t = (corpus_task *)arg;
+  corpus_index *ix = t->ix;
+  for (uint32_t id = t->id; id < ix->count; id += t->num_threads) {
+    int psize = (int)ix->attr[CORPUS_SIZE][id];
+    int **grid = allocSudokuPuzzle(psize);
+    if (grid == NULL) {
+      printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+      exit(EXIT_FAILURE);
+    }
+    tokenizer tok = {t->text + ix->offset[id], ix->length[id], 0};
+    int size_token;
+    tokenizer_next(&tok, &size_token);
+    uint64_t clues = 0;
+    for (int row = 1; row <= psize; row++) {
+      tokenizer_read_ints(&tok, &grid[row][1], psize);
+      for (int col = 1; col <= psize; col++) { clues += grid[row][col] != 0; }
+    }
+    search_options opts = search_default_options(psize);
+    opts.threads = 1;
+    opts.tt_bits = 0;
+    opts.max_nodes = CORPUS_MAX_NODES;
+    search_stats stats;
+    solvePuzzleSearch(psize, grid, &opts, &stats);
+    ix->attr[CORPUS_CLUES][id] = clues;
+    ix->attr[CORPUS_DIFFICULTY][id] = stats.nodes;
+    deleteSudokuPuzzle(psize, grid);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Orders ids by one attribute column, then by id.
+ */
+int corpus_order_cmp(const void *a, const void *b, void *column) {
+  const uint64_t *v = (const uint64_t *)column;
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  if (v[x] != v[y]) { return v[x] < v[y] ? -1 : 1; }
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Indexes a corpus (see the section comment).
+ * @param num_threads Threads rating the puzzles.
+ * @return The number of puzzles; exits on a malformed corpus.
+ */
+uint32_t buildCorpusIndex(const char *corpus, int num_threads) {
+  size_t size;
+  const char *text = (const char *)map_file(corpus, &size);
+  if (text == MAP_FAILED) {
+    printf("Could not open file %s\n", corpus);
+    exit(EXIT_FAILURE);
+  }
+  // First pass: where each puzzle is and its size
+  size_t cap = 1024;
+  uint64_t *spans = (uint64_t *)malloc(3 * cap * sizeof(uint64_t));
+  int *scratch = NULL;
+  size_t scratch_cap = 0;
+  uint32_t count = 0;
+  tokenizer tok = {text, size, 0};
+  for (;;) {
+    while (tok.pos < size && is_space_byte(text[tok.pos])) { tok.pos++; }
+    size_t start = tok.pos;
+    int psize;
+    int got = tokenizer_next(&tok, &psize);
+    if (got == 0) { break; }
+    int box = got == 1 && psize > 0 ? (int)sqrt(psize) : 0;
+    size_t cells = (size_t)box * box * box * box;
+    if (got < 0 || psize < 1 || box * box != psize) {
+      printf("Could not read the size of puzzle %u at byte %zu of %s\n", count,
+             start, corpus);
+      exit(EXIT_FAILURE);
+    }
+    if (cells > scratch_cap) {
+      scratch_cap = cells;
+      scratch = (int *)realloc(scratch, scratch_cap * sizeof(int));
+    }
+    if ((size_t)tokenizer_read_ints(&tok, scratch, cells) != cells) {
+      printf("Could not read the cells of puzzle %u at byte %zu of %s\n",
+             count, start, corpus);
+      exit(EXIT_FAILURE);
+    }
+    if (count == cap) {
+      cap *= 2;
+      spans = (uint64_t *)realloc(spans, 3 * cap * sizeof(uint64_t));
+    }
+    spans[3 * count] = start;
+    spans[3 * count + 1] = tok.pos - start;
+    spans[3 * count + 2] = psize;
+    count++;
+  }
+  free(scratch);
+
+  size_t bytes = corpus_index_bytes(count);
+  corpus_index_header *header = (corpus_index_header *)calloc(1, bytes);
+  memcpy(header->magic, CORPUS_INDEX_MAGIC, 8);
+  header->version = CORPUS_INDEX_VERSION;
+  header->count = count;
+  header->corpus_size = size;
+  corpus_index ix;
+  corpus_index_bind(&ix, header, count);
+  for (uint32_t id = 0; id < count; id++) {
+    ix.offset[id] = spans[3 * id];
+    ix.length[id] = spans[3 * id + 1];
+    ix.attr[CORPUS_SIZE][id] = spans[3 * id + 2];
+  }
+  free(spans);
+
+  // Second pass: clues and difficulty, in parallel
+  pthread_t threads[num_threads];
+  corpus_task tasks[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    tasks[i] = (corpus_task){&ix, text, i, num_threads};
+    if (num_threads == 1) {
+      corpus_rate_worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, corpus_rate_worker, &tasks[i]);
+    }
+  }
+  for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (int a = 0; a < CORPUS_NUM_ATTRS; a++) {
+    for (uint32_t id = 0; id < count; id++) { ix.order[a][id] = id; }
+    qsort_r(ix.order[a], count, sizeof(uint32_t), corpus_order_cmp,
+            ix.attr[a]);
+  }
+  if (text != NULL) { munmap((void *)text, size); }
+
+  char *path = corpus_index_path(corpus);
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL || fwrite(header, 1, bytes, fp) != bytes ||
+      fclose(fp) != 0) {
+    printf("Could not write file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  free(path);
+  free(header);
+  return count;
+}
+
+/**
+ * @brief Maps a corpus's index and checks that it matches the corpus.
+ * @return false (having printed why) if there is no usable index.
+ */
+bool openCorpusIndex(const char *corpus, corpus_index *ix) {
+  char *path = corpus_index_path(corpus);
+  size_t size = 0;
+  void *map = map_file(path, &size);
+  struct stat st;
+  bool ok = map != MAP_FAILED && map != NULL &&
+            size >= sizeof(corpus_index_header);
+  const corpus_index_header *h = (const corpus_index_header *)map;
+  ok = ok && memcmp(h->magic, CORPUS_INDEX_MAGIC, 8) == 0 &&
+       h->version == CORPUS_INDEX_VERSION &&
+       size == corpus_index_bytes(h->count);
+  if (!ok) {
+    printf("Could not read index %s; build it with --corpus-index\n", path);
+  } else if (stat(corpus, &st) != 0 || (uint64_t)st.st_size != h->corpus_size) {
+    printf("Index %s does not match %s; rebuild it with --corpus-index\n",
+           path, corpus);
+    ok = false;
+  }
+  free(path);
+  if (!ok) {
+    if (map != MAP_FAILED && map != NULL) { munmap(map, size); }
+    return false;
+  }
+  corpus_index_bind(ix, map, h->count);
+  ix->map = map;
+  ix->map_size = size;
+  return true;
+}
+
+/**
+ * @brief Unmaps an index from openCorpusIndex.
+ */
+void closeCorpusIndex(corpus_index *ix) { munmap(ix->map, ix->map_size); }
+
+/**
+ * @brief Copies one puzzle's text from the corpus to stdout.
+ * @return false if it could not be read.
+ */
+bool corpus_print(int fd, const corpus_index *ix, uint32_t id) {
+  char buf[65536];
+  uint64_t off = ix->offset[id], left = ix->length[id];
+  while (left > 0) {
+    size_t want = left < sizeof(buf) ? left : sizeof(buf);
+    ssize_t got = pread(fd, buf, want, off);
+    if (got <= 0) { return false; }
+    fwrite(buf, 1, got, stdout);
+    off += got;
+    left -= got;
+  }
+  putchar('\n');
+  return true;
+}
+
+/**
+ * @brief First position in an attribute's sorted column whose value is at
+ * least value.
+ */
+uint32_t corpus_lower_bound(const corpus_index *ix, int a, uint64_t value) {
+  uint32_t lo = 0, hi = ix->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (ix->attr[a][ix->order[a][mid]] < value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief Collects the ids whose attributes all lie in [lo[a], hi[a]].
+ * @param out Output: the matching ids, to free.
+ * @return The number of matches.
+ */
+uint32_t corpus_filter(const corpus_index *ix, const uint64_t *lo,
+                       const uint64_t *hi, uint32_t **out) {
+  // Walk the narrowest sorted range, check the rest by id
+  int best = 0;
+  uint32_t best_begin = 0, best_end = ix->count;
+  for (int a = 0; a < CORPUS_NUM_ATTRS; a++) {
+    uint32_t begin = corpus_lower_bound(ix, a, lo[a]);
+    uint32_t end = hi[a] == UINT64_MAX ? ix->count
+                                       : corpus_lower_bound(ix, a, hi[a] + 1);
+    if (end < begin) { end = begin; }
+    if (end - begin < best_end - best_begin) {
+      best = a;
+      best_begin = begin;
+      best_end = end;
+    }
+  }
+  *out = (uint32_t *)malloc(((size_t)(best_end - best_begin) + 1) *
+                            sizeof(uint32_t));
+  uint32_t n = 0;
+  for (uint32_t i = best_begin; i < best_end; i++) {
+    uint32_t id = ix->order[best][i];
+    bool match = true;
+    for (int a = 0; a < CORPUS_NUM_ATTRS && match; a++) {
+      match = ix->attr[a][id] >= lo[a] && ix->attr[a][id] <= hi[a];
+    }
+    if (match) { (*out)[n++] = id; }
+  }
+  return n;
+}
+
+/**
+ * @brief Parses "N", "MIN-MAX", "MIN-" or "-MAX" into an inclusive range.
+ * @return false if the text is not a range.
+ */
+bool parse_range(const char *text, uint64_t *lo, uint64_t *hi) {
+  char *end;
+  *lo = 0;
+  *hi = UINT64_MAX;
+  if (*text != '-') {
+    *lo = strtoull(text, &end, 10);
+    if (end == text) { return false; }
+    text = end;
+    if (*text == '\0') {
+      *hi = *lo;
+      return true;
+    }
+  }
+  if (*text++ != '-') { return false; }
+  if (*text == '\0') { return true; }
+  *hi = strtoull(text, &end, 10);
+  return end != text && *end == '\0' && *lo <= *hi;
+}
+
+/**
+ * @brief Entry point of --corpus-index, --corpus-get and --corpus-sample.
+ * @param mode The mode argument.
+ * @param argc Number of arguments after the mode.
+ * @param argv The corpus file, then the mode's arguments (see printUsage).
+ */
+int runCorpus(const char *mode, int argc, char **argv) {
+  if (strcmp(mode, "--corpus-index") == 0 && (argc == 1 || argc == 2)) {
+    int num_threads = argc == 2 ? atoi(argv[1])
+                                : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1) { num_threads = 1; }
+    uint32_t count = buildCorpusIndex(argv[0], num_threads);
+    printf("Indexed %u puzzle(s) of %s\n", count, argv[0]);
+    return EXIT_SUCCESS;
+  }
+  bool get = strcmp(mode, "--corpus-get") == 0;
+  if (argc < 2 || (!get && strcmp(mode, "--corpus-sample") != 0)) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  // Ids for --corpus-get; count, ranges and seed for --corpus-sample
+  uint64_t lo[CORPUS_NUM_ATTRS], hi[CORPUS_NUM_ATTRS];
+  for (int a = 0; a < CORPUS_NUM_ATTRS; a++) {
+    lo[a] = 0;
+    hi[a] = UINT64_MAX;
+  }
+  uint64_t seed = 1;
+  long wanted = get ? 0 : atol(argv[1]);
+  bool ok = get || wanted > 0;
+  for (int i = 2; !get && ok && i < argc; i += 2) {
+    int a = 0;
+    while (a < CORPUS_NUM_ATTRS && (strncmp(argv[i], "--", 2) != 0 ||
+                                    strcmp(argv[i] + 2, corpus_attr_names[a]))) {
+      a++;
+    }
+    if (i + 1 >= argc) {
+      ok = false;
+    } else if (a < CORPUS_NUM_ATTRS) {
+      ok = parse_range(argv[i + 1], &lo[a], &hi[a]);
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[i + 1], NULL, 10);
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  corpus_index ix;
+  if (!openCorpusIndex(argv[0], &ix)) { return EXIT_FAILURE; }
+  int fd = open(argv[0], O_RDONLY);
+  int status = EXIT_SUCCESS;
+  if (fd < 0) {
+    printf("Could not open file %s\n", argv[0]);
+    status = EXIT_FAILURE;
+  } else if (get) {
+    for (int i = 1; i < argc && status == EXIT_SUCCESS; i++) {
+      char *end;
+      unsigned long id = strtoul(argv[i], &end, 10);
+      if (end == argv[i] || *end != '\0' || id >= ix.count) {
+        printf("No puzzle %s in %s (%u puzzles)\n", argv[i], argv[0], ix.count);
+        status = EXIT_FAILURE;
+      } else if (!corpus_print(fd, &ix, id)) {
+        printf("Could not read puzzle %lu from %s\n", id, argv[0]);
+        status = EXIT_FAILURE;
+      }
+    }
+  } else {
+    uint32_t *ids;
+    uint32_t n = corpus_filter(&ix, lo, hi, &ids);
+    // Partial Fisher-Yates: the first k ids become a uniform sample
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL | 1;
+    uint32_t k = (uint64_t)wanted < n ? (uint32_t)wanted : n;
+    for (uint32_t i = 0; i < k && status == EXIT_SUCCESS; i++) {
+      uint32_t j = i + rng_next(&state) % (n - i);
+      uint32_t t = ids[i];
+      ids[i] = ids[j];
+      ids[j] = t;
+      if (!corpus_print(fd, &ix, ids[i])) {
+        printf("Could not read puzzle %u from %s\n", ids[i], argv[0]);
+        status = EXIT_FAILURE;
+      }
+    }
+    free(ids);
+  }
+  if (fd >= 0) { close(fd); }
+  closeCorpusIndex(&ix);
+  return status;
+}
+
+// --- Uniform Solution Sampler ---
+
+/*
+ * "--sample-solutions" draws completions of a partial grid uniformly at
+ * random. Trying values in a random order is not uniform: a value whose
+ * subtree holds one solution is picked as often as a sibling whose subtree
+ * holds a thousand. The sampler instead counts the solutions below every
+ * node and picks each value with probability proportional to its count:
+ * walking down from the root that way reaches every solution with
+ * probability 1 / (solutions of the puzzle).
+ *
+ * Counting reuses the search engine's state and propagation. Naked and
+ * hidden singles are forced, so they never change the count and the counter
+ * branches, like the search, on the empty cell with the fewest candidates.
+ * Counts are cached by the Zobrist hash of the propagated state in a
+ * direct-mapped table, so a state reached along several paths is counted
+ * once. The root count is computed first on one thread, filling the table;
+ * the samples then run in parallel on the same puzzle and only read the
+ * table, recounting an evicted subtree locally. Sample i draws from its own
+ * generator seeded with (seed, i), so the output does not depend on the
+ * number of threads.
+ */
+
+#define SAMPLE_CACHE_BITS 20
+#define SAMPLE_MAX_NODES 2000000L
+
+// A cached count; hash 0 marks an empty entry
+typedef struct {
+  uint64_t hash;
+  uint64_t count;  // Solutions below the state, UINT64_MAX if saturated
+} sample_entry;
+
+typedef struct {
+  int psize;
+  int **grid;            // The partial grid
+  sample_entry *cache;   // 1 << SAMPLE_CACHE_BITS entries
+  uint64_t seed;
+  long num_samples;
+  int num_threads;
+  uint16_t *samples;     // num_samples solved boards, psize * psize each
+} sample_shared;
+
+// Per-thread counting state
+typedef struct {
+  sample_shared *shared;
+  int thread;
+  search_state s;
+  sweep_scratch sc;
+  int *trail;
+  int trail_len;
+  search_stats stats;    // Only the propagation count is used
+  long nodes;            // Branch values counted
+  long max_nodes;        // 0 for no limit
+  bool store;            // Write counts into the shared cache
+} sample_walker;
+
+/**
+ * @brief Sets up a walker with the puzzle loaded.
+ * @return false if out of memory or if the clues conflict.
+ */
+bool sample_walker_init(sample_walker *w, sample_shared *sh, arena *a) {
+  int psize = sh->psize;
+  memset(w, 0, sizeof(*w));
+  w->shared = sh;
+  void *mem = arena_alloc(a, search_state_bytes(psize));
+  w->trail = (int *)arena_alloc(a, (size_t)psize * psize * sizeof(int));
+  if (mem == NULL || w->trail == NULL || !sweep_scratch_init(&w->sc, a, psize)) {
+    return false;
+  }
+  search_state_bind(&w->s, psize, mem);
+  return search_state_load(&w->s, sh->grid);
+}
+
+/**
+ * @brief Empties the cells assigned after the trail had length len.
+ */
+void sample_undo(sample_walker *w, int len) {
+  while (w->trail_len > len) { search_unassign(&w->s, w->trail[--w->trail_len]); }
+}
+
+/**
+ * @brief Counts the solutions below the walker's state, leaving it unchanged.
+ * @return The count, saturated at UINT64_MAX; 0 as well once the node limit
+ * is hit, which the caller detects from w->nodes.
+ */
+uint64_t sample_count(sample_walker *w) {
+  search_state *s = &w->s;
+  int base = w->trail_len;
+  int cell = 0;
+  int r = search_propagate(s, &w->sc, w->trail, &w->trail_len, &w->stats,
+                           &cell);
+  uint64_t total = r == 0 ? 1 : 0;
+  if (r == 1) {
+    sample_entry *e =
+        &w->shared->cache[s->hash & ((1ULL << SAMPLE_CACHE_BITS) - 1)];
+    if (e->hash == s->hash && s->hash != 0) {
+      sample_undo(w, base);
+      return e->count;
+    }
+    uint64_t hash = s->hash;
+    uint64_t cand[s->words];
+    search_candidates(s, cell, cand);
+    bool complete = true;
+    for (int k = 0; k < s->words && complete; k++) {
+      for (uint64_t bits = cand[k]; bits != 0; bits &= bits - 1) {
+        if (w->max_nodes > 0 && w->nodes >= w->max_nodes) {
+          complete = false;
+          break;
+        }
+        w->nodes++;
+        int mark = w->trail_len;
+        search_assign(s, cell, 64 * k + __builtin_ctzll(bits) + 1);
+        w->trail[w->trail_len++] = cell;
+        uint64_t sub = sample_count(w);
+        sample_undo(w, mark);
+        if (__builtin_add_overflow(total, sub, &total)) { total = UINT64_MAX; }
+      }
+    }
+    if (!complete) { total = 0; }
+    if (complete && w->store && hash != 0) {
+      e->hash = hash;
+      e->count = total;
+    }
+  }
+  sample_undo(w, base);
+  return total;
+}
+
+/**
+ * @brief Returns a uniform value in [0, n) (n > 0), without modulo bias.
+ */
+uint64_t sample_below(uint64_t *state, uint64_t n) {
+  uint64_t limit = UINT64_MAX - UINT64_MAX % n;
+  uint64_t x;
+  do {
+    x = rng_next(state);
+  } while (x >= limit);
+  return x % n;
+}
+
+/**
+ * @brief Draws one solution into out (psize * psize values).
+ * @details The walker must start at the puzzle, which has solutions. Its
+ * state is restored before returning.
+ */
+void sample_draw(sample_walker *w, uint64_t *rng, uint16_t *out) {
+  search_state *s = &w->s;
+  int base = w->trail_len;
+  uint64_t cand[s->words];
+  uint64_t counts[s->psize];
+  int cell = 0;
+  while (search_propagate(s, &w->sc, w->trail, &w->trail_len, &w->stats,
+                          &cell) == 1) {
+    search_candidates(s, cell, cand);
+    uint64_t total = 0;
+    for (int v = 1; v <= s->psize; v++) {
+      counts[v - 1] = 0;
+      if ((cand[(v - 1) >> 6] >> ((v - 1) & 63) & 1) == 0) { continue; }
+      int mark = w->trail_len;
+      search_assign(s, cell, v);
+      w->trail[w->trail_len++] = cell;
+      counts[v - 1] = sample_count(w);
+      sample_undo(w, mark);
+      total += counts[v - 1];
+    }
+    uint64_t pick = sample_below(rng, total);
+    int v = 1;
+    while (pick >= counts[v - 1]) { pick -= counts[v++ - 1]; }
+    search_assign(s, cell, v);
+    w->trail[w->trail_len++] = cell;
+  }
+  memcpy(out, s->cells, (size_t)s->psize * s->psize * sizeof(uint16_t));
+  sample_undo(w, base);
+}
+
+/**
+ * @brief Worker function: draws every num_threads-th sample.
+ * @param arg A sample_walker with its thread number set.
+ * @return NULL.
+ */
+void *sample_worker(void *arg) {
+  sample_walker *w = (sample_walker *)arg;
+  sample_shared *sh = w->shared;
+  size_t cells = (size_t)sh->psize * sh->psize;
+  for (long i = w->thread; i < sh->num_samples; i += sh->num_threads) {
+    uint64_t rng = (sh->seed * 0x9E3779B97F4A7C15ULL) ^ zobrist_key((int)i, 0);
+    sample_draw(w, &rng, sh->samples + i * cells);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Counts the completions of a partial grid and draws samples of them.
+ * @param samples Output: num_samples boards of psize * psize values, malloc'd
+ * (NULL if nothing was drawn).
+ * @param solutions Output: the number of completions.
+ * @return 0 on success, 1 if psize is not a square, the clues conflict or
+ * memory ran out, 2 if
+ * counting gave up after SAMPLE_MAX_NODES nodes, 3 if there are 2^64 or more
+ * completions.
+ */
+int sampleSolutions(int psize, int **grid, long num_samples, int num_threads,
+                    uint64_t seed, uint16_t **samples, uint64_t *solutions) {
+  *samples = NULL;
+  *solutions = 0;
+  sample_shared sh = {psize, grid, NULL, seed, num_samples, num_threads, NULL};
+  sh.cache = (sample_entry *)hugeAlloc(
+      sizeof(sample_entry) << SAMPLE_CACHE_BITS, true);
+  arena arenas[num_threads];
+  sample_walker walkers[num_threads];
+  int box = (int)sqrt(psize);
+  int status = sh.cache == NULL || box * box != psize ? 1 : 0;
+  for (int i = 0; i < num_threads; i++) {
+    arena_init(&arenas[i], 256 * 1024, psize >= HUGE_PAGE_MIN_PSIZE);
+    if (status == 0 && !sample_walker_init(&walkers[i], &sh, &arenas[i])) {
+      status = 1;
+    }
+    walkers[i].thread = i;
+  }
+  if (status == 0) {
+    memset(sh.cache, 0, sizeof(sample_entry) << SAMPLE_CACHE_BITS);
+    walkers[0].store = true;
+    walkers[0].max_nodes = SAMPLE_MAX_NODES;
+    *solutions = sample_count(&walkers[0]);
+    walkers[0].store = false;
+    walkers[0].max_nodes = 0;
+    if (walkers[0].nodes >= SAMPLE_MAX_NODES) {
+      status = 2;
+    } else if (*solutions == UINT64_MAX) {
+      status = 3;
+    }
+  }
+  if (status == 0 && *solutions > 0 && num_samples > 0) {
+    sh.samples = (uint16_t *)malloc(num_samples * (size_t)psize * psize *
+                                    sizeof(uint16_t));
+    if (sh.samples == NULL) { status = 1; }
+  }
+  if (sh.samples != NULL) {
+    pthread_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+      if (num_threads == 1) {
+        sample_worker(&walkers[i]);
+      } else {
+        pthread_create(&threads[i], NULL, sample_worker, &walkers[i]);
+      }
+    }
+    for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    *samples = sh.samples;
+  }
+  for (int i = 0; i < num_threads; i++) { arena_destroy(&arenas[i]); }
+  hugeFree(sh.cache);
+  return status;
+}
+
+/**
+ * @brief Runs "--sample-solutions puzzle.txt count [--threads N] [--seed N]".
+ */
+int runSampleSolutions(int argc, char **argv) {
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t seed = 1;
+  long count = argc >= 2 ? atol(argv[1]) : 0;
+  bool ok = argc >= 2 && count >= 0 && argc % 2 == 0;
+  for (int i = 2; ok && i < argc; i += 2) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      num_threads = atoi(argv[i + 1]);
+      ok = num_threads >= 1;
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[i + 1], NULL, 10);
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  int **grid = NULL;
+  int psize = readSudokuPuzzle(argv[0], &grid);
+  uint16_t *samples;
+  uint64_t solutions;
+  int status = sampleSolutions(psize, grid, count, num_threads, seed, &samples,
+                               &solutions);
+  if (status == 1) {
+    printf("Invalid puzzle or not enough memory\n");
+  } else if (status == 2) {
+    printf("Gave up counting solutions after %ld nodes\n", SAMPLE_MAX_NODES);
+  } else if (status == 3) {
+    printf("Too many solutions to count\n");
+  } else {
+    printf("Solutions: %llu\n", (unsigned long long)solutions);
+    size_t cells = (size_t)psize * psize;
+    for (long i = 0; samples != NULL && i < count; i++) {
+      for (size_t k = 0; k < cells; k++) {
+        grid[k / psize + 1][k % psize + 1] = samples[i * cells + k];
+      }
+      printSudokuPuzzle(psize, grid);
+    }
+  }
+  free(samples);
+  deleteSudokuPuzzle(psize, grid);
+  return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --- Augmented Board Dataset ---
+
+/*
+ * "--augment" turns a small base set of boards into a large training set by
+ * applying transformations that keep a board valid: permuting the bands,
+ * the stacks, the rows within each band and the columns within each stack,
+ * transposing, and relabeling the digits. Every transformed board is
+ * out(r, c) = digit[in(row[r], col[c])], where in is the base board or its
+ * transpose (both are built once, up front), so a transformation is drawn as
+ * two index tables and a digit table of psize entries each, and applying it
+ * is one table lookup per cell. On x86 CPUs with SSSE3, boards up to 15x15
+ * do a row in two byte shuffles: one gathers the source row's cells into the
+ * new column order, the other relabels the digits. That path is compiled
+ * for SSSE3 whatever the build flags and chosen at run time, so a plain
+ * build uses it too.
+ *
+ * Boards are written to a board file, a header followed by the boards, one
+ * byte per cell, row-major, 0 for an empty cell:
+ *
+ *   board_file_header   magic, version, psize
+ *   uint8_t cells[count][psize * psize]
+ *
+ * so the number of boards is (file size - header) / (psize * psize). Board
+ * i is transformed from base board i % (base boards) with a generator
+ * seeded from (seed, i). Threads fill chunks of AUGMENT_CHUNK boards in
+ * memory and pwrite each chunk at its place in the file, so the file does
+ * not depend on the number of threads and is streamed, not held in memory.
+ */
+
+#define BOARD_FILE_MAGIC "SUDOKBRD"
+#define BOARD_FILE_VERSION 1
+#define AUGMENT_CHUNK 4096
+
+typedef struct {
+  char magic[8];     // BOARD_FILE_MAGIC
+  uint32_t version;  // BOARD_FILE_VERSION
+  uint32_t psize;    // Boards are psize x psize, at most 255
+} board_file_header;
+
+typedef struct {
+  int psize;
+  int box;
+  int num_base;
+  const uint8_t *base[2];  // num_base boards, psize * psize bytes each, and
+                           // their transposes; 16 bytes of slack after each
+  uint64_t count;       // Boards to write
+  uint64_t seed;
+  int fd;
+  int num_threads;
+  int failed;           // A write failed
+  bool ssse3;           // The CPU has SSSE3 (see augment_rows_ssse3)
+} augment_shared;
+
+typedef struct {
+  augment_shared *shared;
+  int thread;
+} augment_task;
+
+/**
+ * @brief Shuffles v[0..n) with Fisher-Yates.
+ * @details Indexes are scaled from the top 32 bits of the generator rather
+ * than taken modulo i + 1: a board needs a few dozen of them and divisions
+ * would cost more than transforming the board.
+ */
+void shuffle_ints(int *v, int n, uint64_t *rng) {
+  for (int i = n - 1; i > 0; i--) {
+    int j = (int)(((rng_next(rng) >> 32) * (uint64_t)(i + 1)) >> 32);
+    int t = v[i];
+    v[i] = v[j];
+    v[j] = t;
+  }
+}
+
+/**
+ * @brief Draws a random band/row (or stack/column) order.
+ * @param out psize entries: the source line of line i.
+ */
+void augment_lines(int box, uint64_t *rng, uint8_t *out) {
+  int bands[box], rows[box];
+  for (int b = 0; b < box; b++) { bands[b] = b; }
+  shuffle_ints(bands, box, rng);
+  for (int b = 0; b < box; b++) {
+    for (int i = 0; i < box; i++) { rows[i] = i; }
+    shuffle_ints(rows, box, rng);
+    for (int i = 0; i < box; i++) {
+      out[b * box + i] = (uint8_t)(bands[b] * box + rows[i]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Writes the rows of a transformed board of at most 15x15 with two
+ * byte shuffles each.
+ * @details Built for SSSE3 regardless of the compiler flags; only call it
+ * when __builtin_cpu_supports("ssse3").
+ * @param row, col, digit The source row of each row, the source column of
+ * each column and the new label of each digit, 16 bytes each.
+ */
+__attribute__((target("ssse3"))) void
+augment_rows_ssse3(int psize, const uint8_t *in, const uint8_t *row,
+                   const uint8_t *col, const uint8_t *digit, uint8_t *out) {
+  // Slots past psize pick cell 0; what they write is overwritten by the
+  // next row or lands in the slack
+  __m128i order = _mm_loadu_si128((const __m128i *)col);
+  __m128i relabel = _mm_loadu_si128((const __m128i *)digit);
+  for (int r = 0; r < psize; r++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(in + row[r] * psize));
+    v = _mm_shuffle_epi8(relabel, _mm_shuffle_epi8(v, order));
+    _mm_storeu_si128((__m128i *)(out + r * psize), v);
+  }
+}
+#endif
+
+/**
+ * @brief Writes a randomly transformed copy of base board id.
+ * @param out psize * psize cells, followed by 16 bytes of slack.
+ */
+void augment_board(const augment_shared *sh, uint64_t id, uint8_t *out,
+                   uint64_t *rng) {
+  int psize = sh->psize;
+  size_t cells = (size_t)psize * psize;
+  const uint8_t *in = sh->base[rng_next(rng) & 1] + id * (cells + 16);
+  uint8_t row[16 > psize ? 16 : psize], col[16 > psize ? 16 : psize];
+  memset(col, 0, sizeof(col));
+  augment_lines(sh->box, rng, row);
+  augment_lines(sh->box, rng, col);
+  int digits[psize + 1];
+  for (int v = 0; v <= psize; v++) { digits[v] = v; }
+  shuffle_ints(digits + 1, psize, rng);
+  uint8_t digit[16 > psize + 1 ? 16 : psize + 1];
+  memset(digit, 0, sizeof(digit));
+  for (int v = 0; v <= psize; v++) { digit[v] = (uint8_t)digits[v]; }
+#if defined(__x86_64__) || defined(__i386__)
+  if (sh->ssse3 && psize <= 15) {
+    augment_rows_ssse3(psize, in, row, col, digit, out);
+    return;
+  }
+#endif
+  for (int r = 0; r < psize; r++) {
+    const uint8_t *src = in + (size_t)row[r] * psize;
+    uint8_t *dst = out + (size_t)r * psize;
+    for (int c = 0; c < psize; c++) { dst[c] = digit[src[col[c]]]; }
+  }
+}
+
+/**
+ * @brief Worker function: writes every num_threads-th chunk of boards.
+ * @param arg An augment_task.
+ * @return NULL.
+ */
+void *augment_worker(void *arg) {
+  augment_task *t = (augment_task *)arg;
+  augment_shared *sh = t->shared;
+  size_t cells = (size_t)sh->psize * sh->psize;
+  uint8_t *buf = (uint8_t *)malloc(AUGMENT_CHUNK * cells + 16);
+  if (buf == NULL) {
+    __atomic_store_n(&sh->failed, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  uint64_t chunks = (sh->count + AUGMENT_CHUNK - 1) / AUGMENT_CHUNK;
+  for (uint64_t k = t->thread; k < chunks; k += sh->num_threads) {
+    if (__atomic_load_n(&sh->failed, __ATOMIC_RELAXED)) { break; }
+    uint64_t first = k * AUGMENT_CHUNK;
+    uint64_t n = sh->count - first < AUGMENT_CHUNK ? sh->count - first
+                                                   : AUGMENT_CHUNK;
+    for (uint64_t j = 0; j < n; j++) {
+      uint64_t i = first + j;
+      uint64_t rng = (sh->seed * 0x9E3779B97F4A7C15ULL) ^
+                     zobrist_key((int)(i >> 16), (int)(i & 0xFFFF));
+      augment_board(sh, i % sh->num_base, buf + j * cells, &rng);
+    }
+    size_t bytes = n * cells;
+    off_t at = (off_t)(sizeof(board_file_header) + first * cells);
+    if (pwrite(sh->fd, buf, bytes, at) != (ssize_t)bytes) {
+      __atomic_store_n(&sh->failed, 1, __ATOMIC_RELAXED);
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+/**
+ * @brief Reads every board of a file of puzzles into one byte per cell.
+ * @param psize Output: the size shared by all the boards.
+ * @return The number of boards (malloc'd into *boards), or 0 (having printed
+ * why) if the file is unreadable, empty, mixes sizes or has a size that is
+ * not a positive square of at most 255.
+ */
+int read_base_boards(const char *filename, int *psize, uint8_t **boards) {
+  size_t len;
+  char *text = readWholeFile(filename, &len);
+  if (text == NULL) {
+    printf("Could not open file %s\n", filename);
+    return 0;
+  }
+  tokenizer tok = {text, len, 0};
+  int n = 0, size, got;
+  int *row = NULL;
+  *boards = NULL;
+  *psize = 0;
+  while ((got = tokenizer_next(&tok, &size)) == 1) {
+    int box = size > 0 ? (int)sqrt(size) : 0;
+    if (size < 1 || box * box != size || size > 255 ||
+        (n > 0 && size != *psize)) {
+      got = -1;
+      break;
+    }
+    *psize = size;
+    size_t cells = (size_t)size * size;
+    row = (int *)realloc(row, size * sizeof(int));
+    *boards = (uint8_t *)realloc(*boards, (n + 1) * cells);
+    for (int r = 0; r < size && got == 1; r++) {
+      if (tokenizer_read_ints(&tok, row, size) != size) { got = -1; }
+      for (int c = 0; got == 1 && c < size; c++) {
+        if (row[c] < 0 || row[c] > size) { got = -1; }
+        (*boards)[n * cells + (size_t)r * size + c] = (uint8_t)row[c];
+      }
+    }
+    if (got != 1) { break; }
+    n++;
+  }
+  free(row);
+  free(text);
+  if (got != 0 || n == 0) {
+    printf("Could not read board %d of %s (boards must share one square size "
+           "of at most 255)\n", n, filename);
+    free(*boards);
+    *boards = NULL;
+    return 0;
+  }
+  return n;
+}
+
+/**
+ * @brief Writes count transformed copies of the base boards to a board file.
+ * @return false (having printed why) if the file could not be written.
+ */
+bool augmentBoards(int psize, const uint8_t *base, int num_base,
+                   uint64_t count, uint64_t seed, const char *path,
+                   int num_threads) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  board_file_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BOARD_FILE_MAGIC, 8);
+  h.version = BOARD_FILE_VERSION;
+  h.psize = psize;
+  size_t cells = (size_t)psize * psize;
+  uint8_t *copies = (uint8_t *)calloc(2 * (size_t)num_base, cells + 16);
+  augment_shared sh = {psize, (int)sqrt(psize), num_base, {copies, NULL},
+                       count, seed, fd, num_threads, 0, false};
+  sh.base[1] = copies + (size_t)num_base * (cells + 16);
+#if defined(__x86_64__) || defined(__i386__)
+  sh.ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+  for (int b = 0; copies != NULL && b < num_base; b++) {
+    for (size_t k = 0; k < cells; k++) {
+      uint8_t v = base[b * cells + k];
+      copies[b * (cells + 16) + k] = v;
+      copies[(num_base + b) * (cells + 16) + (k % psize) * psize + k / psize] =
+          v;
+    }
+  }
+  sh.failed = copies == NULL || fd < 0 ||
+              write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h);
+  int started = sh.failed ? 0 : num_threads;
+  pthread_t threads[num_threads];
+  augment_task tasks[num_threads];
+  for (int i = 0; i < started; i++) {
+    tasks[i] = (augment_task){&sh, i};
+    if (num_threads == 1) {
+      augment_worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, augment_worker, &tasks[i]);
+    }
+  }
+  for (int i = 0; num_threads > 1 && i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (fd >= 0 && close(fd) != 0) { sh.failed = 1; }
+  free(copies);
+  if (sh.failed) { printf("Could not write file %s\n", path); }
+  return !sh.failed;
+}
+
+/**
+ * @brief Prints boards of a board file in the puzzle file format.
+ * @return false (having printed why) if the file is not a board file or
+ * holds fewer than first + count boards.
+ */
+bool printBoardFile(const char *path, uint64_t first, uint64_t count) {
+  size_t size = 0;
+  const uint8_t *map = (const uint8_t *)map_file(path, &size);
+  const board_file_header *h = (const board_file_header *)map;
+  bool ok = map != MAP_FAILED && map != NULL &&
+            size >= sizeof(board_file_header) &&
+            memcmp(h->magic, BOARD_FILE_MAGIC, 8) == 0 &&
+            h->version == BOARD_FILE_VERSION && h->psize >= 1 &&
+            h->psize <= 255;
+  size_t cells = ok ? (size_t)h->psize * h->psize : 1;
+  uint64_t total = ok ? (size - sizeof(board_file_header)) / cells : 0;
+  if (!ok) {
+    printf("%s is not a board file\n", path);
+  } else if (first > total || count > total - first) {
+    printf("%s holds %llu board(s)\n", path, (unsigned long long)total);
+    ok = false;
+  }
+  for (uint64_t i = first; ok && i < first + count; i++) {
+    const uint8_t *b = map + sizeof(board_file_header) + i * cells;
+    printf("%u\n", h->psize);
+    for (size_t k = 0; k < cells; k++) {
+      printf("%d%s", b[k], (k + 1) % h->psize == 0 ? " \n" : " ");
+    }
+    printf("\n");
+  }
+  if (map != MAP_FAILED && map != NULL) { munmap((void *)map, size); }
+  return ok;
+}
+
+/**
+ * @brief Runs "--augment base.txt count out.bin [--threads N] [--seed N]"
+ * and "--boards-print file.bin [first] [count]".
+ */
+int runAugment(const char *mode, int argc, char **argv) {
+  if (strcmp(mode, "--boards-print") == 0 && argc >= 1 && argc <= 3) {
+    uint64_t first = argc >= 2 ? strtoull(argv[1], NULL, 10) : 0;
+    uint64_t count = argc >= 3 ? strtoull(argv[2], NULL, 10) : 1;
+    return printBoardFile(argv[0], first, count) ? EXIT_SUCCESS
+                                                  : EXIT_FAILURE;
+  }
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t seed = 1;
+  bool ok = strcmp(mode, "--augment") == 0 && argc >= 3 && argc % 2 == 1;
+  uint64_t count = ok ? strtoull(argv[1], NULL, 10) : 0;
+  for (int i = 3; ok && i < argc; i += 2) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      num_threads = atoi(argv[i + 1]);
+      ok = num_threads >= 1;
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[i + 1], NULL, 10);
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  int psize;
+  uint8_t *base;
+  int num_base = read_base_boards(argv[0], &psize, &base);
+  if (num_base == 0) { return EXIT_FAILURE; }
+  double start = now_seconds();
+  ok = augmentBoards(psize, base, num_base, count, seed, argv[2], num_threads);
+  double seconds = now_seconds() - start;
+  free(base);
+  if (!ok) { return EXIT_FAILURE; }
+  printf("Wrote %llu %dx%d board(s) from %d base board(s) to %s\n",
+         (unsigned long long)count, psize, psize, num_base, argv[2]);
+  if (seconds >= 0.1) {
+    printf("%.0f boards/s\n", count / seconds);
+  }
+  return EXIT_SUCCESS;
+}
+
+// --- Tensor Export ---
+
+/*
+ * "--export-tensors" writes puzzles as one-hot tensors that a training
+ * loader maps instead of parsing text. For every puzzle the file holds three
+ * planes of psize x psize x psize elements, indexed [row][column][value - 1]:
+ *
+ *   TENSOR_PUZZLE      1 where the cell is a clue with that value
+ *   TENSOR_CANDIDATES  1 where the value is still possible once naked and
+ *                      hidden singles are propagated (a filled cell has
+ *                      only its value)
+ *   TENSOR_SOLUTION    1 for the solution's value; all 0 if the search
+ *                      found no solution within EXPORT_MAX_NODES
+ *
+ * The file is a tensor_file_header (64 bytes, so the data stays aligned)
+ * followed by one record per puzzle, the three planes in that order. With
+ * bytes, an element is a uint8_t; with "--bits" the value axis is packed,
+ * ceil(psize / 8) bytes per cell, value v - 1 in bit (v - 1) % 8 of byte
+ * (v - 1) / 8 (numpy's unpackbits with bitorder="little"). The output is
+ * sized up front and mapped; threads take every num_threads-th puzzle and
+ * write its record in place.
+ */
+
+#define TENSOR_FILE_MAGIC "SUDOKTNS"
+#define TENSOR_FILE_VERSION 1
+#define EXPORT_MAX_NODES 1000000
+
+enum { TENSOR_PUZZLE, TENSOR_CANDIDATES, TENSOR_SOLUTION, NUM_TENSOR_PLANES };
+
+typedef struct {
+  char magic[8];          // TENSOR_FILE_MAGIC
+  uint32_t version;       // TENSOR_FILE_VERSION
+  uint32_t psize;
+  uint64_t count;         // Records
+  uint32_t planes;        // NUM_TENSOR_PLANES
+  uint32_t bits;          // 1 if the value axis is packed, else 0
+  uint64_t cell_bytes;    // Bytes per cell of one plane
+  uint64_t record_bytes;  // planes * psize * psize * cell_bytes
+  char reserved[16];
+} tensor_file_header;
+
+typedef struct {
+  int psize;
+  const uint8_t *boards;  // count puzzles, psize * psize bytes each
+  uint64_t count;
+  bool bits;
+  size_t cell_bytes;
+  size_t record_bytes;
+  uint8_t *records;       // The mapped output after the header
+  int num_threads;
+  long unsolved;          // Puzzles with an empty solution plane
+} tensor_shared;
+
+typedef struct {
+  tensor_shared *shared;
+  int thread;
+} tensor_task;
+
+/**
+ * @brief Sets value v of a cell in one plane of a record.
+ */
+void tensor_set(const tensor_shared *sh, uint8_t *plane, int cell, int v) {
+  uint8_t *at = plane + (size_t)cell * sh->cell_bytes;
+  if (sh->bits) {
+    at[(v - 1) >> 3] |= 1 << ((v - 1) & 7);
+  } else {
+    at[v - 1] = 1;
+  }
+}
+
+/**
+ * @brief Worker function: writes the records of every num_threads-th puzzle.
+ * @param arg A tensor_task.
+ * @return NULL.
+ */
+void *tensor_worker(void *arg) {
+  tensor_task *t = (tensor_task *)arg;
+  tensor_shared *sh = t->shared;
+  int psize = sh->psize;
+  int cells = psize * psize;
+  size_t plane_bytes = (size_t)cells * sh->cell_bytes;
+  arena a;
+  arena_init(&a, 256 * 1024, psize >= HUGE_PAGE_MIN_PSIZE);
+  search_state s;
+  sweep_scratch sc;
+  void *mem = arena_alloc(&a, search_state_bytes(psize));
+  int **grid = allocSudokuPuzzle(psize);
+  if (mem == NULL || grid == NULL || !sweep_scratch_init(&sc, &a, psize)) {
+    printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+    exit(EXIT_FAILURE);
+  }
+  search_state_bind(&s, psize, mem);
+  search_options opts = search_default_options(psize);
+  opts.threads = 1;
+  opts.max_nodes = EXPORT_MAX_NODES;
+  uint64_t cand[s.words];
+  long unsolved = 0;
+  for (uint64_t id = t->thread; id < sh->count; id += sh->num_threads) {
+    const uint8_t *board = sh->boards + id * cells;
+    uint8_t *record = sh->records + id * sh->record_bytes;
+    uint8_t *puzzle = record + TENSOR_PUZZLE * plane_bytes;
+    uint8_t *candidates = record + TENSOR_CANDIDATES * plane_bytes;
+    uint8_t *solution = record + TENSOR_SOLUTION * plane_bytes;
+    for (int k = 0; k < cells; k++) {
+      grid[k / psize + 1][k % psize + 1] = board[k];
+      if (board[k] != 0) { tensor_set(sh, puzzle, k, board[k]); }
+    }
+    search_stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    int trail_len = 0, cell = 0;
+    // A contradiction leaves the candidate plane empty
+    if (search_state_load(&s, grid) &&
+        search_propagate(&s, &sc, NULL, &trail_len, &stats, &cell) >= 0) {
+      for (int k = 0; k < cells; k++) {
+        if (s.cells[k] != 0) {
+          tensor_set(sh, candidates, k, s.cells[k]);
+          continue;
+        }
+        search_candidates(&s, k, cand);
+        for (int w = 0; w < s.words; w++) {
+          for (uint64_t b = cand[w]; b != 0; b &= b - 1) {
+            tensor_set(sh, candidates, k, 64 * w + __builtin_ctzll(b) + 1);
+          }
+        }
+      }
+    }
+    if (solvePuzzleSearch(psize, grid, &opts, &stats) == SEARCH_SOLVED) {
+      for (int k = 0; k < cells; k++) {
+        tensor_set(sh, solution, k, grid[k / psize + 1][k % psize + 1]);
+      }
+    } else {
+      unsolved++;
+    }
+  }
+  __atomic_fetch_add(&sh->unsolved, unsolved, __ATOMIC_RELAXED);
+  deleteSudokuPuzzle(psize, grid);
+  arena_destroy(&a);
+  return NULL;
+}
+
+/**
+ * @brief Writes the tensor file of count puzzles (see the section comment).
+ * @param unsolved Output: puzzles written with an empty solution plane.
+ * @return false (having printed why) if the file could not be written.
+ */
+bool exportTensors(int psize, const uint8_t *boards, uint64_t count,
+                   bool bits, const char *path, int num_threads,
+                   long *unsolved) {
+  tensor_shared sh;
+  sh.psize = psize;
+  sh.boards = boards;
+  sh.count = count;
+  sh.bits = bits;
+  sh.cell_bytes = bits ? (psize + 7) / 8 : psize;
+  sh.record_bytes =
+      NUM_TENSOR_PLANES * (size_t)psize * psize * sh.cell_bytes;
+  sh.num_threads = num_threads;
+  sh.unsolved = 0;
+  size_t bytes = sizeof(tensor_file_header) + count * sh.record_bytes;
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  void *map = MAP_FAILED;
+  if (fd >= 0 && ftruncate(fd, bytes) == 0) {
+    map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (fd >= 0) { close(fd); }
+  if (map == MAP_FAILED) {
+    printf("Could not write file %s\n", path);
+    return false;
+  }
+  // ftruncate zero-filled the records; workers only set the ones
+  tensor_file_header *h = (tensor_file_header *)map;
+  memcpy(h->magic, TENSOR_FILE_MAGIC, 8);
+  h->version = TENSOR_FILE_VERSION;
+  h->psize = psize;
+  h->count = count;
+  h->planes = NUM_TENSOR_PLANES;
+  h->bits = bits;
+  h->cell_bytes = sh.cell_bytes;
+  h->record_bytes = sh.record_bytes;
+  sh.records = (uint8_t *)map + sizeof(tensor_file_header);
+  pthread_t threads[num_threads];
+  tensor_task tasks[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    tasks[i] = (tensor_task){&sh, i};
+    if (num_threads == 1) {
+      tensor_worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, tensor_worker, &tasks[i]);
+    }
+  }
+  for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  bool ok = munmap(map, bytes) == 0;
+  if (!ok) { printf("Could not write file %s\n", path); }
+  *unsolved = sh.unsolved;
+  return ok;
+}
+
+/**
+ * @brief Runs "--export-tensors puzzles.txt out.tensors [--bits]
+ * [--threads N]".
+ */
+int runExportTensors(int argc, char **argv) {
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  bool bits = false;
+  bool ok = argc >= 2;
+  for (int i = 2; ok && i < argc; i++) {
+    if (strcmp(argv[i], "--bits") == 0) {
+      bits = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+      ok = num_threads >= 1;
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  int psize;
+  uint8_t *boards;
+  int count = read_base_boards(argv[0], &psize, &boards);
+  if (count == 0) { return EXIT_FAILURE; }
+  long unsolved;
+  ok = exportTensors(psize, boards, count, bits, argv[1], num_threads,
+                     &unsolved);
+  free(boards);
+  if (!ok) { return EXIT_FAILURE; }
+  printf("Exported %d %dx%d puzzle(s) to %s", count, psize, psize, argv[1]);
+  if (unsolved > 0) { printf(", %ld without a solution", unsolved); }
+  printf("\n");
+  return EXIT_SUCCESS;
+}
+
+// --- Nearest Valid Repair ---
+
+/*
+ * "--repair" finds a valid grid as close as possible to an invalid board:
+ * the fewest filled cells changed (empty cells may take any value). Two
+ * cells with the same value in a row, column or subgrid cannot both stay,
+ * so the repair branches on such a conflict, changing one cell or the
+ * other, until the cells it keeps are conflict-free. If some empty cell then
+ * has no candidate, one of its row, column or subgrid peers has to change
+ * too, and the repair branches on those. Otherwise the search engine checks
+ * that the kept cells can be completed; if not, some other kept cell has to
+ * change and the repair branches on all of them.
+ *
+ * Depth-first branch and bound over the number of changes k = 0, 1, 2, ...
+ * (iterative deepening) makes the first grid found a nearest one. At each
+ * k the branches at depth REPAIR_SPLIT are dealt out round-robin to the
+ * threads. A thread skips subtrees numbered after the first one known to
+ * hold a repair, and of the repairs found at the smallest k the one in the
+ * first subtree wins, so the answer does not depend on the thread count.
+ * The repair stops at a time limit; completability checks are capped at
+ * REPAIR_MAX_NODES search nodes and count as failures when they give up.
+ */
+
+#define REPAIR_SPLIT 3
+#define REPAIR_MAX_NODES 100000
+#define REPAIR_TIME_LIMIT_MS 10000
+
+typedef struct {
+  int psize;
+  int box;
+  int **board;          // The input
+  int k;                // Changes allowed in this round
+  int num_threads;
+  double deadline;      // now_seconds() at which to give up
+  long best;            // First subtree holding a repair, LONG_MAX if none
+  int timed_out;
+  int **solution;       // The repair found in subtree best
+  pthread_mutex_t lock;
+} repair_shared;
+
+typedef struct {
+  repair_shared *shared;
+  int thread;
+  long subtree;         // Subtrees at depth REPAIR_SPLIT seen so far
+  bool *changed;        // Cells given up, row-major
+  int **grid;           // The kept cells, 0 elsewhere
+  int **work;           // Scratch for completing grid
+  int *seen;            // Scratch: cell holding each value in a unit
+} repair_task;
+
+/**
+ * @brief Finds two kept cells with the same value in one unit.
+ * @return false if the kept cells are conflict-free.
+ */
+bool repair_conflict(repair_task *t, int *a, int *b) {
+  repair_shared *sh = t->shared;
+  int psize = sh->psize, box = sh->box;
+  for (int kind = 0; kind < 3; kind++) {
+    for (int unit = 0; unit < psize; unit++) {
+      for (int v = 1; v <= psize; v++) { t->seen[v] = -1; }
+      for (int i = 0; i < psize; i++) {
+        int r = kind == 0 ? unit : kind == 1 ? i
+                                             : (unit / box) * box + i / box;
+        int c = kind == 0 ? i : kind == 1 ? unit
+                                          : (unit % box) * box + i % box;
+        int v = t->grid[r + 1][c + 1];
+        if (v == 0) { continue; }
+        if (t->seen[v] >= 0) {
+          *a = t->seen[v];
+          *b = r * psize + c;
+          return true;
+        }
+        t->seen[v] = r * psize + c;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Returns true if two different cells share a row, column or subgrid.
+ */
+bool repair_peers(int box, int psize, int x, int y) {
+  int xr = x / psize, xc = x % psize, yr = y / psize, yc = y % psize;
+  return x != y && (xr == yr || xc == yc ||
+                    (xr / box == yr / box && xc / box == yc / box));
+}
+
+/**
+ * @brief Finds an empty cell of the kept grid that no value fits.
+ * @return The cell, or -1 if every empty cell has a candidate.
+ */
+int repair_dead_cell(repair_task *t) {
+  repair_shared *sh = t->shared;
+  int psize = sh->psize, box = sh->box;
+  for (int x = 0; x < psize * psize; x++) {
+    int r = x / psize, c = x % psize;
+    if (t->grid[r + 1][c + 1] != 0) { continue; }
+    for (int v = 1; v <= psize; v++) { t->seen[v] = 0; }
+    int used = 0;
+    for (int i = 0; i < psize; i++) {
+      int br = (r / box) * box + i / box, bc = (c / box) * box + i % box;
+      int peer[3] = {t->grid[r + 1][i + 1], t->grid[i + 1][c + 1],
+                     t->grid[br + 1][bc + 1]};
+      for (int k = 0; k < 3; k++) {
+        used += peer[k] != 0 && !t->seen[peer[k]];
+        if (peer[k] != 0) { t->seen[peer[k]] = 1; }
+      }
+    }
+    if (used == psize) { return x; }
+  }
+  return -1;
+}
+
+/**
+ * @brief Gives up a cell (or takes it back) in a task's kept grid.
+ */
+void repair_set(repair_task *t, int cell, bool changed) {
+  int psize = t->shared->psize;
+  t->changed[cell] = changed;
+  t->grid[cell / psize + 1][cell % psize + 1] =
+      changed ? 0 : t->shared->board[cell / psize + 1][cell % psize + 1];
+}
+
+/**
+ * @brief Explores the repairs that give up at most left more cells.
+ * @param depth Cells given up so far.
+ * @param from Smallest cell that may be given up without a conflict
+ * forcing it, so that each set of such cells is tried once.
+ * @param id Number of the subtree this node is in, -1 above the split.
+ * @return true to stop this round.
+ */
+bool repair_branch(repair_task *t, int depth, int left, int from, long id) {
+  repair_shared *sh = t->shared;
+  int psize = sh->psize;
+  int a, b;
+  bool conflict = repair_conflict(t, &a, &b);
+  if (id < 0 && (depth == REPAIR_SPLIT || left == 0 || !conflict)) {
+    // Every thread walks the tree above the split and numbers the same
+    // subtrees; each explores its own
+    id = t->subtree++;
+    if (id % sh->num_threads != t->thread) { return false; }
+  }
+  if (id >= 0 && id > __atomic_load_n(&sh->best, __ATOMIC_RELAXED)) {
+    return true;
+  }
+  if (now_seconds() > sh->deadline) {
+    __atomic_store_n(&sh->timed_out, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+  if (conflict) {
+    int choice[2] = {a, b};
+    for (int i = 0; left > 0 && i < 2; i++) {
+      repair_set(t, choice[i], true);
+      bool stop = repair_branch(t, depth + 1, left - 1, from, id);
+      repair_set(t, choice[i], false);
+      if (stop) { return true; }
+    }
+    return false;
+  }
+  int dead = repair_dead_cell(t);
+  for (int cell = 0; dead >= 0 && left > 0 && cell < psize * psize; cell++) {
+    if (t->grid[cell / psize + 1][cell % psize + 1] == 0 ||
+        !repair_peers(sh->box, psize, dead, cell)) {
+      continue;
+    }
+    repair_set(t, cell, true);
+    bool stop = repair_branch(t, depth + 1, left - 1, from, id);
+    repair_set(t, cell, false);
+    if (stop) { return true; }
+  }
+  if (dead >= 0) { return false; }
+  copySudokuPuzzle(psize, t->work, t->grid);
+  search_options opts = search_default_options(psize);
+  opts.threads = 1;
+  opts.tt_bits = 0;
+  opts.max_nodes = REPAIR_MAX_NODES;
+  if (solvePuzzleSearch(psize, t->work, &opts, NULL) == SEARCH_SOLVED) {
+    pthread_mutex_lock(&sh->lock);
+    if (id < sh->best) {
+      sh->best = id;
+      copySudokuPuzzle(psize, sh->solution, t->work);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return true;
+  }
+  // Conflict-free but not completable: give up kept cells beyond conflicts
+  for (int cell = from; left > 0 && cell < psize * psize; cell++) {
+    if (t->changed[cell] || sh->board[cell / psize + 1][cell % psize + 1] == 0) {
+      continue;
+    }
+    repair_set(t, cell, true);
+    bool stop = repair_branch(t, depth + 1, left - 1, cell + 1, id);
+    repair_set(t, cell, false);
+    if (stop) { return true; }
+  }
+  return false;
+}
+
+/**
+ * @brief Worker function: explores this task's share of one round.
+ * @param arg A repair_task.
+ * @return NULL.
+ */
+void *repair_worker(void *arg) {
+  repair_task *t = (repair_task *)arg;
+  t->subtree = 0;
+  repair_branch(t, 0, t->shared->k, 0, -1);
+  return NULL;
+}
+
+/**
+ * @brief Finds a valid grid with the fewest filled cells changed.
+ * @param solution Output: the repaired grid (allocated by the caller).
+ * @param time_limit_ms Give up after this long.
+ * @return The number of cells changed, or -1 if no repair was found in
+ * time, with *searched set to the largest number of changes ruled out
+ * completely (-1 if none).
+ */
+int repairPuzzle(int psize, int **board, int **solution, int num_threads,
+                 double time_limit_ms, int *searched) {
+  repair_shared sh;
+  sh.psize = psize;
+  sh.box = (int)sqrt(psize);
+  sh.board = board;
+  sh.num_threads = num_threads;
+  sh.deadline = now_seconds() + time_limit_ms / 1000;
+  sh.timed_out = 0;
+  sh.solution = solution;
+  pthread_mutex_init(&sh.lock, NULL);
+  int filled = 0;
+  for (int r = 1; r <= psize; r++) {
+    for (int c = 1; c <= psize; c++) { filled += board[r][c] != 0; }
+  }
+  repair_task tasks[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    tasks[i].shared = &sh;
+    tasks[i].thread = i;
+    tasks[i].changed = (bool *)calloc((size_t)psize * psize, sizeof(bool));
+    tasks[i].grid = allocSudokuPuzzle(psize);
+    tasks[i].work = allocSudokuPuzzle(psize);
+    tasks[i].seen = (int *)malloc((psize + 1) * sizeof(int));
+    if (tasks[i].changed == NULL || tasks[i].grid == NULL ||
+        tasks[i].work == NULL || tasks[i].seen == NULL) {
+      printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+      exit(EXIT_FAILURE);
+    }
+    copySudokuPuzzle(psize, tasks[i].grid, board);
+  }
+  int result = -1;
+  *searched = -1;
+  for (int k = 0; k <= filled && result < 0 && !sh.timed_out; k++) {
+    sh.k = k;
+    sh.best = LONG_MAX;
+    pthread_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+      if (num_threads == 1) {
+        repair_worker(&tasks[i]);
+      } else {
+        pthread_create(&threads[i], NULL, repair_worker, &tasks[i]);
+      }
+    }
+    for (int i = 0; num_threads > 1 && i < num_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    if (sh.best != LONG_MAX) {
+      result = k;
+    } else if (!sh.timed_out) {
+      *searched = k;
+    }
+  }
+  for (int i = 0; i < num_threads; i++) {
+    free(tasks[i].changed);
+    deleteSudokuPuzzle(psize, tasks[i].grid);
+    deleteSudokuPuzzle(psize, tasks[i].work);
+    free(tasks[i].seen);
+  }
+  pthread_mutex_destroy(&sh.lock);
+  return result;
+}
+
+/**
+ * @brief Runs "--repair puzzle.txt [--threads N] [--time-limit MS]".
+ */
+int runRepair(int argc, char **argv) {
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  double limit_ms = REPAIR_TIME_LIMIT_MS;
+  bool ok = argc >= 1 && argc % 2 == 1;
+  for (int i = 1; ok && i < argc; i += 2) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      num_threads = atoi(argv[i + 1]);
+      ok = num_threads >= 1;
+    } else if (strcmp(argv[i], "--time-limit") == 0) {
+      limit_ms = atof(argv[i + 1]);
+      ok = limit_ms > 0;
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  int **board = NULL;
+  int psize = readSudokuPuzzle(argv[0], &board);
+  int box = (int)sqrt(psize);
+  bool in_range = box * box == psize;
+  for (int r = 1; in_range && r <= psize; r++) {
+    for (int c = 1; c <= psize; c++) {
+      in_range = in_range && board[r][c] >= 0 && board[r][c] <= psize;
+    }
+  }
+  if (!in_range) {
+    printf("Cannot repair %s: the size is not a square or a value is out of "
+           "range\n", argv[0]);
+    deleteSudokuPuzzle(psize, board);
+    return EXIT_FAILURE;
+  }
+  int **solution = allocSudokuPuzzle(psize);
+  int searched;
+  int changes =
+      repairPuzzle(psize, board, solution, num_threads, limit_ms, &searched);
+  if (changes < 0) {
+    printf("No repair found within %.0f ms", limit_ms);
+    if (searched >= 0) { printf(" (searched up to %d change(s))", searched); }
+    printf("\n");
+  } else if (changes == 0) {
+    printf("No changes needed\n");
+    printSudokuPuzzle(psize, solution);
+  } else {
+    printf("Nearest valid grid changes %d cell(s):\n", changes);
+    for (int r = 1; r <= psize; r++) {
+      for (int c = 1; c <= psize; c++) {
+        if (board[r][c] != 0 && board[r][c] != solution[r][c]) {
+          printf("  row %d, column %d: %d -> %d\n", r, c, board[r][c],
+                 solution[r][c]);
+        }
+      }
+    }
+    printSudokuPuzzle(psize, solution);
+  }
+  deleteSudokuPuzzle(psize, solution);
+  deleteSudokuPuzzle(psize, board);
+  return changes >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --- Duplicate Detection ---
+
+/*
+ * "--dedup" finds puzzles of a corpus that are the same puzzle up to the
+ * transformations "--augment" applies (band, stack, row and column
+ * permutations, transposition, digit relabeling). Comparing every pair
+ * under all transformations is far too slow, so each puzzle first gets a
+ * fingerprint, computed in one pass over the grid, that no transformation
+ * changes:
+ *
+ *   - the size and the number of clues;
+ *   - for the bands, the multiset of (sorted clue counts of the band's
+ *     rows), and the same for the stacks and their columns, the two taken
+ *     as an unordered pair since transposing swaps them;
+ *   - the sorted clue counts of the subgrids;
+ *   - the sorted number of clues of each digit.
+ *
+ * Fingerprints go into an open-addressing hash table of puzzle ids, so the
+ * earlier puzzles that could be the same as a given one are found in O(1).
+ * Only those go through the full check, puzzle_equivalent, which
+ * backtracks over row and then column orders, pruning on row clue counts
+ * and on a consistent digit relabeling. Each puzzle is reported as a
+ * duplicate of the first earlier puzzle it is equivalent to; puzzles are
+ * checked in parallel, each against the ids before it, so the report does
+ * not depend on the number of threads.
+ */
+
+typedef struct {
+  int psize;
+  uint8_t *cells;  // psize * psize, row-major, 0 = empty
+} dedup_puzzle;
+
+/**
+ * @brief Folds x into the hash h (splitmix64 finalizer).
+ */
+uint64_t fp_mix(uint64_t h, uint64_t x) {
+  x = (x ^ h) + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Orders uint64_t values.
+ */
+int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Hashes the multiset of band signatures, a band's signature being
+ * the sorted clue counts of its lines.
+ * @param lines psize clue counts, line by line.
+ */
+uint64_t fp_bands(const uint64_t *lines, int box) {
+  uint64_t sig[box], line[box];
+  for (int b = 0; b < box; b++) {
+    memcpy(line, lines + b * box, box * sizeof(uint64_t));
+    qsort(line, box, sizeof(uint64_t), compare_u64);
+    sig[b] = 0;
+    for (int i = 0; i < box; i++) { sig[b] = fp_mix(sig[b], line[i]); }
+  }
+  qsort(sig, box, sizeof(uint64_t), compare_u64);
+  uint64_t h = 0;
+  for (int b = 0; b < box; b++) { h = fp_mix(h, sig[b]); }
+  return h;
+}
+
+/**
+ * @brief Computes a puzzle's transformation-invariant fingerprint.
+ */
+uint64_t puzzleFingerprint(int psize, const uint8_t *cells) {
+  int box = (int)sqrt(psize);
+  uint64_t rows[psize], cols[psize], boxes[psize], digits[psize + 1];
+  memset(rows, 0, sizeof(rows));
+  memset(cols, 0, sizeof(cols));
+  memset(boxes, 0, sizeof(boxes));
+  memset(digits, 0, sizeof(digits));
+  for (int r = 0; r < psize; r++) {
+    for (int c = 0; c < psize; c++) {
+      int v = cells[r * psize + c];
+      if (v == 0) { continue; }
+      rows[r]++;
+      cols[c]++;
+      boxes[(r / box) * box + c / box]++;
+      digits[v]++;
+    }
+  }
+  uint64_t clues = 0;
+  for (int r = 0; r < psize; r++) { clues += rows[r]; }
+  uint64_t h = fp_mix(fp_mix(0, psize), clues);
+  uint64_t hr = fp_bands(rows, box), hc = fp_bands(cols, box);
+  h = fp_mix(fp_mix(h, hr < hc ? hr : hc), hr < hc ? hc : hr);
+  qsort(boxes, psize, sizeof(uint64_t), compare_u64);
+  qsort(digits + 1, psize, sizeof(uint64_t), compare_u64);
+  for (int i = 0; i < psize; i++) { h = fp_mix(h, boxes[i]); }
+  for (int v = 1; v <= psize; v++) { h = fp_mix(h, digits[v]); }
+  return h;
+}
+
+// Search state of one puzzle_equivalent call
+typedef struct {
+  int psize, box;
+  const uint8_t *a;     // Target puzzle
+  const uint8_t *b;     // Source puzzle, possibly transposed
+  int *row, *col;       // Source row / column of each target row / column
+  bool *row_used, *col_used;     // Source rows / columns taken
+  int *band, *stack;             // Source band / stack of each target one
+  bool *band_used, *stack_used;  // Source bands / stacks taken
+  uint8_t *fwd, *bwd;   // Digit relabeling source -> target and back
+  int *a_rows, *b_rows; // Clue counts per row
+} equiv_search;
+
+/**
+ * @brief Assigns source columns to target columns c.. with the rows fixed.
+ */
+bool equiv_cols(equiv_search *e, int c) {
+  int psize = e->psize, box = e->box;
+  if (c == psize) { return true; }
+  int first = c % box == 0 ? 0 : e->stack[c / box];
+  int last = c % box == 0 ? box - 1 : first;
+  for (int s = first; s <= last; s++) {
+    if (c % box == 0) {
+      if (e->stack_used[s]) { continue; }
+      e->stack_used[s] = true;
+      e->stack[c / box] = s;
+    }
+    for (int i = 0; i < box; i++) {
+      int src = s * box + i;
+      if (e->col_used[src]) { continue; }
+      // Relabelings this column adds, undone on the way back
+      uint8_t added[psize];
+      int num_added = 0;
+      bool ok = true;
+      for (int r = 0; ok && r < psize; r++) {
+        int va = e->a[r * psize + c];
+        int vb = e->b[e->row[r] * psize + src];
+        if ((va == 0) != (vb == 0)) {
+          ok = false;
+        } else if (vb != 0 && e->fwd[vb] == 0 && e->bwd[va] == 0) {
+          e->fwd[vb] = va;
+          e->bwd[va] = vb;
+          added[num_added++] = vb;
+        } else if (vb != 0 && e->fwd[vb] != va) {
+          ok = false;
+        }
+      }
+      if (ok) {
+        e->col_used[src] = true;
+        e->col[c] = src;
+        ok = equiv_cols(e, c + 1);
+        e->col_used[src] = false;
+      }
+      for (int k = 0; k < num_added; k++) {
+        e->bwd[e->fwd[added[k]]] = 0;
+        e->fwd[added[k]] = 0;
+      }
+      if (ok) { return true; }
+    }
+    if (c % box == 0) { e->stack_used[s] = false; }
+  }
+  return false;
+}
+
+/**
+ * @brief Assigns source rows to target rows r.., then tries the columns.
+ */
+bool equiv_rows(equiv_search *e, int r) {
+  int psize = e->psize, box = e->box;
+  if (r == psize) { return equiv_cols(e, 0); }
+  int first = r % box == 0 ? 0 : e->band[r / box];
+  int last = r % box == 0 ? box - 1 : first;
+  for (int s = first; s <= last; s++) {
+    if (r % box == 0) {
+      if (e->band_used[s]) { continue; }
+      e->band_used[s] = true;
+      e->band[r / box] = s;
+    }
+    for (int i = 0; i < box; i++) {
+      int src = s * box + i;
+      if (e->row_used[src] || e->b_rows[src] != e->a_rows[r]) { continue; }
+      e->row_used[src] = true;
+      e->row[r] = src;
+      bool ok = equiv_rows(e, r + 1);
+      e->row_used[src] = false;
+      if (ok) { return true; }
+    }
+    if (r % box == 0) { e->band_used[s] = false; }
+  }
+  return false;
+}
+
+/**
+ * @brief Checks whether some transformation turns puzzle b into puzzle a.
+ */
+bool puzzle_equivalent(int psize, const uint8_t *a, const uint8_t *b) {
+  int box = (int)sqrt(psize);
+  size_t cells = (size_t)psize * psize;
+  uint8_t bt[cells];
+  int row[psize], col[psize], band[box], stack[box];
+  int a_rows[psize], b_rows[psize];
+  bool row_used[psize], col_used[psize], band_used[box], stack_used[box];
+  uint8_t fwd[psize + 1], bwd[psize + 1];
+  equiv_search e = {psize, box, a, b, row, col, row_used, col_used,
+                    band, stack, band_used, stack_used, fwd, bwd,
+                    a_rows, b_rows};
+  for (size_t k = 0; k < cells; k++) {
+    bt[(k % psize) * psize + k / psize] = b[k];
+  }
+  for (int transpose = 0; transpose < 2; transpose++) {
+    e.b = transpose ? bt : b;
+    for (int r = 0; r < psize; r++) {
+      a_rows[r] = b_rows[r] = 0;
+      for (int c = 0; c < psize; c++) {
+        a_rows[r] += a[r * psize + c] != 0;
+        b_rows[r] += e.b[r * psize + c] != 0;
+      }
+    }
+    memset(row_used, 0, sizeof(row_used));
+    memset(col_used, 0, sizeof(col_used));
+    memset(band_used, 0, sizeof(band_used));
+    memset(stack_used, 0, sizeof(stack_used));
+    memset(fwd, 0, sizeof(fwd));
+    memset(bwd, 0, sizeof(bwd));
+    if (equiv_rows(&e, 0)) { return true; }
+  }
+  return false;
+}
+
+/**
+ * @brief Reads every puzzle of a corpus, one byte per cell.
+ * @return The puzzles (count in *count), or NULL (having printed why) if
+ * the corpus is unreadable or holds a size that is not a positive square of
+ * at most 255.
+ */
+dedup_puzzle *read_dedup_corpus(const char *filename, uint32_t *count) {
+  size_t len;
+  char *text = readWholeFile(filename, &len);
+  if (text == NULL) {
+    printf("Could not open file %s\n", filename);
+    return NULL;
+  }
+  tokenizer tok = {text, len, 0};
+  dedup_puzzle *puzzles = NULL;
+  uint32_t n = 0;
+  int psize, got;
+  int *row = NULL;
+  while ((got = tokenizer_next(&tok, &psize)) == 1) {
+    int box = psize > 0 ? (int)sqrt(psize) : 0;
+    if (psize < 1 || box * box != psize || psize > 255) {
+      got = -1;
+      break;
+    }
+    puzzles = (dedup_puzzle *)realloc(puzzles, (n + 1) * sizeof(dedup_puzzle));
+    row = (int *)realloc(row, psize * sizeof(int));
+    uint8_t *cells = (uint8_t *)malloc((size_t)psize * psize);
+    puzzles[n] = (dedup_puzzle){psize, cells};
+    for (int r = 0; r < psize && got == 1; r++) {
+      if (tokenizer_read_ints(&tok, row, psize) != psize) { got = -1; }
+      for (int c = 0; got == 1 && c < psize; c++) {
+        if (row[c] < 0 || row[c] > psize) { got = -1; }
+        cells[r * psize + c] = (uint8_t)row[c];
+      }
+    }
+    n++;
+    if (got != 1) { break; }
+  }
+  free(row);
+  free(text);
+  if (got != 0) {
+    printf("Could not read puzzle %u of %s\n", n > 0 ? n - 1 : 0, filename);
+    for (uint32_t i = 0; i < n; i++) { free(puzzles[i].cells); }
+    free(puzzles);
+    return NULL;
+  }
+  *count = n;
+  return puzzles;
+}
+
+// State shared by the dedup workers
+typedef struct {
+  const dedup_puzzle *puzzles;
+  uint32_t count;
+  uint64_t *fingerprint;  // By id
+  uint32_t *next;         // Next id with the same fingerprint, or count
+  uint32_t *first;        // Hash table: first id of a fingerprint, or count
+  uint64_t mask;          // Table slots - 1
+  uint32_t *dup_of;       // First earlier equivalent puzzle, or count
+  int num_threads;
+  long checks;            // Full equivalence checks run
+  long mismatches;        // Checks that found no transformation
+} dedup_shared;
+
+typedef struct {
+  dedup_shared *shared;
+  int thread;
+} dedup_task;
+
+/**
+ * @brief Finds the table slot of a fingerprint (empty or holding it).
+ */
+uint64_t dedup_slot(const dedup_shared *sh, uint64_t fp) {
+  uint64_t slot = fp & sh->mask;
+  while (sh->first[slot] != sh->count &&
+         sh->fingerprint[sh->first[slot]] != fp) {
+    slot = (slot + 1) & sh->mask;
+  }
+  return slot;
+}
+
+/**
+ * @brief Worker function: fingerprints every num_threads-th puzzle.
+ * @param arg A dedup_task.
+ * @return NULL.
+ */
+void *dedup_fingerprint_worker(void *arg) {
+  dedup_task *t = (dedup_task *)arg;
+  dedup_shared *sh = t->shared;
+  for (uint32_t id = t->thread; id < sh->count; id += sh->num_threads) {
+    sh->fingerprint[id] =
+        puzzleFingerprint(sh->puzzles[id].psize, sh->puzzles[id].cells);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Worker function: checks every num_threads-th puzzle against the
+ * earlier puzzles with its fingerprint.
+ * @param arg A dedup_task.
+ * @return NULL.
+ */
+void *dedup_check_worker(void *arg) {
+  dedup_task *t = (dedup_task *)arg;
+  dedup_shared *sh = t->shared;
+  long checks = 0, mismatches = 0;
+  for (uint32_t id = t->thread; id < sh->count; id += sh->num_threads) {
+    const dedup_puzzle *p = &sh->puzzles[id];
+    uint32_t j = sh->first[dedup_slot(sh, sh->fingerprint[id])];
+    for (; j < id; j = sh->next[j]) {
+      checks++;
+      // A fingerprint can collide across sizes; never compare those cells
+      if (sh->puzzles[j].psize == p->psize &&
+          puzzle_equivalent(p->psize, p->cells, sh->puzzles[j].cells)) {
+        sh->dup_of[id] = j;
+        break;
+      }
+      mismatches++;
+    }
+  }
+  __atomic_fetch_add(&sh->checks, checks, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&sh->mismatches, mismatches, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/**
+ * @brief Runs one dedup worker function on num_threads threads.
+ */
+void dedup_run(dedup_shared *sh, void *(*worker)(void *)) {
+  int n = sh->num_threads;
+  pthread_t threads[n];
+  dedup_task tasks[n];
+  for (int i = 0; i < n; i++) {
+    tasks[i] = (dedup_task){sh, i};
+    if (n == 1) {
+      worker(&tasks[i]);
+    } else {
+      pthread_create(&threads[i], NULL, worker, &tasks[i]);
+    }
+  }
+  for (int i = 0; n > 1 && i < n; i++) { pthread_join(threads[i], NULL); }
+}
+
+/**
+ * @brief Runs "--dedup corpus.txt [threads]": lists the puzzles that are
+ * transformations of an earlier one.
+ */
+int runDedup(int argc, char **argv) {
+  int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc < 1 || argc > 2 || num_threads < 1) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  uint32_t count;
+  dedup_puzzle *puzzles = read_dedup_corpus(argv[0], &count);
+  if (puzzles == NULL) { return EXIT_FAILURE; }
+  dedup_shared sh;
+  sh.puzzles = puzzles;
+  sh.count = count;
+  sh.num_threads = num_threads;
+  sh.checks = 0;
+  sh.mismatches = 0;
+  uint64_t slots = 16;
+  while (slots < 2 * (uint64_t)count) { slots *= 2; }
+  sh.mask = slots - 1;
+  sh.fingerprint = (uint64_t *)malloc((count + 1) * sizeof(uint64_t));
+  sh.next = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+  sh.dup_of = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+  sh.first = (uint32_t *)malloc(slots * sizeof(uint32_t));
+  uint32_t *last = (uint32_t *)malloc(slots * sizeof(uint32_t));
+  for (uint64_t s = 0; s < slots; s++) { sh.first[s] = count; }
+  dedup_run(&sh, dedup_fingerprint_worker);
+  // Chains are built in id order, so they list ids in increasing order
+  for (uint32_t id = 0; id < count; id++) {
+    uint64_t slot = dedup_slot(&sh, sh.fingerprint[id]);
+    if (sh.first[slot] == count) {
+      sh.first[slot] = id;
+    } else {
+      sh.next[last[slot]] = id;
+    }
+    last[slot] = id;
+    sh.next[id] = count;
+    sh.dup_of[id] = count;
+  }
+  free(last);
+  dedup_run(&sh, dedup_check_worker);
+  uint32_t dups = 0;
+  for (uint32_t id = 0; id < count; id++) {
+    if (sh.dup_of[id] == count) { continue; }
+    printf("Puzzle %u duplicates puzzle %u\n", id, sh.dup_of[id]);
+    dups++;
+  }
+  printf("%u puzzle(s), %u duplicate(s); %ld full check(s), %ld of them "
+         "fingerprint collisions\n",
+         count, dups, sh.checks, sh.mismatches);
+  for (uint32_t i = 0; i < count; i++) { free(puzzles[i].cells); }
+  free(puzzles);
+  free(sh.fingerprint);
+  free(sh.next);
+  free(sh.dup_of);
+  free(sh.first);
+  return EXIT_SUCCESS;
+}
+
+// --- Solve Trace ---
+
+/*
+ * "--trace puzzle.txt out.trace" solves a puzzle with the search engine
+ * and saves the steps it recorded (see the Backtracking Search Engine
+ * section): a trace_file_header, the puzzle as psize * psize uint16 cells
+ * padded to a multiple of 8 bytes, then one 8-byte trace_step per step.
+ * Nothing but the steps is stored. "--replay file.trace" lists the steps in
+ * words, and "--replay file.trace N" prints the board after step N,
+ * rebuilt by applying the first N steps to the puzzle: a single or guess
+ * fills its cell, and a backtrack empties the cells filled since the step
+ * it returns to.
+ */
+
+#define TRACE_FILE_MAGIC "SUDOKTRC"
+#define TRACE_FILE_VERSION 1
+
+typedef struct {
+  char magic[8];     // TRACE_FILE_MAGIC, not NUL-terminated
+  uint32_t version;  // TRACE_FILE_VERSION
+  uint32_t psize;
+  uint64_t steps;
+} trace_file_header;
+
+const char *trace_rule_names[NUM_TRACE_RULES] = {
+    "naked single", "hidden single in its row", "hidden single in its column",
+    "hidden single in its subgrid", "guess", "backtrack"};
+
+/**
+ * @brief Bytes of the puzzle in a trace file, padded to 8.
+ */
+size_t trace_clue_bytes(int psize) {
+  return ((size_t)psize * psize * sizeof(uint16_t) + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Writes a puzzle and the trace of its solve to a file.
+ * @param grid The puzzle as given, before solving.
+ * @return false if the file could not be written.
+ */
+bool writeTrace(const char *path, int psize, int **grid,
+                const solve_trace *t) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) { return false; }
+  trace_file_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, TRACE_FILE_MAGIC, 8);
+  h.version = TRACE_FILE_VERSION;
+  h.psize = psize;
+  h.steps = t->len;
+  uint16_t *clues = (uint16_t *)calloc(1, trace_clue_bytes(psize));
+  bool ok = clues != NULL;
+  for (int r = 0; ok && r < psize; r++) {
+    for (int c = 0; c < psize; c++) {
+      clues[r * psize + c] = grid[r + 1][c + 1];
+    }
+  }
+  ok = ok && fwrite(&h, sizeof(h), 1, f) == 1 &&
+       fwrite(clues, trace_clue_bytes(psize), 1, f) == 1 &&
+       fwrite(t->steps, sizeof(trace_step), t->len, f) == t->len;
+  free(clues);
+  return fclose(f) == 0 && ok;
+}
+
+/**
+ * @brief Rebuilds the board after the first n steps of a trace.
+ * @param clues The puzzle, psize * psize cells.
+ * @param board Output: psize * psize cells.
+ * @return false if a step does not fit the board (the file is damaged).
+ */
+bool replayTrace(int psize, const uint16_t *clues, const trace_step *steps,
+                 size_t n, uint16_t *board) {
+  size_t ncells = (size_t)psize * psize;
+  memcpy(board, clues, ncells * sizeof(uint16_t));
+  size_t *filled = (size_t *)malloc((ncells + 1) * sizeof(size_t));
+  size_t num_filled = 0;  // Steps that filled a cell still filled, in order
+  bool ok = filled != NULL;
+  for (size_t i = 0; ok && i < n; i++) {
+    const trace_step *st = &steps[i];
+    if (st->rule == TRACE_BACKTRACK) {
+      ok = st->cell <= i;
+      while (ok && num_filled > 0 && filled[num_filled - 1] >= st->cell) {
+        board[steps[filled[--num_filled]].cell] = 0;
+      }
+    } else {
+      ok = st->rule < NUM_TRACE_RULES && st->cell < ncells &&
+           board[st->cell] == 0 && st->digit >= 1 && st->digit <= psize &&
+           num_filled < ncells;
+      if (ok) {
+        board[st->cell] = st->digit;
+        filled[num_filled++] = i;
+      }
+    }
+  }
+  free(filled);
+  return ok;
+}
+
+/**
+ * @brief Runs "--trace puzzle.txt out.trace".
+ */
+int runTrace(int argc, char **argv) {
+  if (argc != 2) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  int **grid = NULL;
+  int psize = readSudokuPuzzle(argv[0], &grid);
+  int **puzzle = allocSudokuPuzzle(psize);
+  if (puzzle == NULL) {
+    printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+    return EXIT_FAILURE;
+  }
+  copySudokuPuzzle(psize, puzzle, grid);
+  solve_trace trace;
+  memset(&trace, 0, sizeof(trace));
+  search_options opts = search_default_options(psize);
+  opts.trace = &trace;
+  int status = solvePuzzleSearch(psize, grid, &opts, NULL);
+  long count[NUM_TRACE_RULES] = {0};
+  for (size_t i = 0; i < trace.len; i++) { count[trace.steps[i].rule]++; }
+  int ret = EXIT_SUCCESS;
+  if (trace.failed) {
+    printf("Not enough memory for the trace\n");
+    ret = EXIT_FAILURE;
+  } else if (!writeTrace(argv[1], psize, puzzle, &trace)) {
+    printf("Could not write %s\n", argv[1]);
+    ret = EXIT_FAILURE;
+  } else {
+    printf("Recorded %zu step(s) to %s: %ld single(s), %ld guess(es), %ld "
+           "backtrack(s)%s\n",
+           trace.len, argv[1],
+           (long)trace.len - count[TRACE_GUESS] - count[TRACE_BACKTRACK],
+           count[TRACE_GUESS], count[TRACE_BACKTRACK],
+           status == SEARCH_SOLVED ? "" : "; no solution found");
+  }
+  free(trace.steps);
+  deleteSudokuPuzzle(psize, puzzle);
+  deleteSudokuPuzzle(psize, grid);
+  return ret;
+}
+
+/**
+ * @brief Runs "--replay file.trace [step]": lists the steps, or prints the
+ * board after the given step (0 for the puzzle).
+ */
+int runReplay(int argc, char **argv) {
+  if (argc < 1 || argc > 2) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  size_t size = 0;
+  const uint8_t *map = (const uint8_t *)map_file(argv[0], &size);
+  const trace_file_header *h = (const trace_file_header *)map;
+  bool ok = map != MAP_FAILED && map != NULL && size >= sizeof(*h) &&
+            memcmp(h->magic, TRACE_FILE_MAGIC, 8) == 0 &&
+            h->version == TRACE_FILE_VERSION && h->psize >= 1 &&
+            h->psize <= UINT16_MAX;
+  int psize = ok ? (int)h->psize : 0;
+  size_t steps_at = sizeof(*h) + trace_clue_bytes(psize);
+  ok = ok && size >= steps_at &&
+       (size - steps_at) / sizeof(trace_step) == h->steps &&
+       (size - steps_at) % sizeof(trace_step) == 0;
+  if (!ok) {
+    printf("%s is not a trace file\n", argv[0]);
+    if (map != MAP_FAILED && map != NULL) { munmap((void *)map, size); }
+    return EXIT_FAILURE;
+  }
+  const uint16_t *clues = (const uint16_t *)(map + sizeof(*h));
+  const trace_step *steps = (const trace_step *)(map + steps_at);
+  size_t n = h->steps;
+  if (argc == 2) {
+    char *end;
+    unsigned long long want = strtoull(argv[1], &end, 10);
+    ok = *end == '\0' && want <= n;
+    if (!ok) { printf("%s holds %zu step(s)\n", argv[0], n); }
+    n = ok ? (size_t)want : 0;
+  }
+  uint16_t *board = (uint16_t *)malloc((size_t)psize * psize * 2);
+  int **grid = allocSudokuPuzzle(psize);
+  if (ok && (board == NULL || grid == NULL)) {
+    printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+    ok = false;
+  }
+  if (ok && !replayTrace(psize, clues, steps, n, board)) {
+    printf("%s is damaged\n", argv[0]);
+    ok = false;
+  }
+  if (ok && argc == 2) {
+    for (int r = 0; r < psize; r++) {
+      for (int c = 0; c < psize; c++) {
+        grid[r + 1][c + 1] = board[r * psize + c];
+      }
+    }
+    printSudokuPuzzle(psize, grid);
+  }
+  for (size_t i = 0; ok && argc == 1 && i < n; i++) {
+    const trace_step *st = &steps[i];
+    int row = st->cell / psize + 1, col = st->cell % psize + 1;
+    if (st->rule == TRACE_BACKTRACK) {
+      printf("Step %zu: backtracks to the board after step %u\n", i + 1,
+             st->cell);
+    } else if (st->rule == TRACE_GUESS) {
+      printf("Step %zu: guesses grid[%d][%d] as %d\n", i + 1, row, col,
+             st->digit);
+    } else {
+      printf("Step %zu, pass %d: finds grid[%d][%d] as %d, %s\n", i + 1,
+             st->pass, row, col, st->digit, trace_rule_names[st->rule]);
+    }
+  }
+  free(board);
+  if (grid != NULL) { deleteSudokuPuzzle(psize, grid); }
+  munmap((void *)map, size);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --- Benchmark Harness ---
+
+/*
+ * Benchmark modes are selected with a "--bench-..." first argument instead of
+ * a puzzle file. They generate their own boards so that any size can be
+ * measured without a matching puzzle file.
+ */
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief xorshift64* pseudo random generator; state must be non-zero.
+ */
+uint64_t rng_next(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Copies the cells of src into dst. Both must have the same psize.
+ */
+void copySudokuPuzzle(int psize, int **dst, int **src) {
+  for (int row = 1; row <= psize; row++) {
+    memcpy(&dst[row][1], &src[row][1], psize * sizeof(int));
+  }
+}
+
+/**
+ * @brief Builds a complete, valid puzzle of any square size.
+ * @details Uses the shifted-row pattern: row r starts where row r - 1 did,
+ * shifted by one subgrid width, with an extra shift of one at each band.
+ * @param psize The size of the puzzle; must be a perfect square.
+ */
+int **makeSolvedPuzzle(int psize) {
+  int n = sqrt(psize);
+  int **grid = allocSudokuPuzzle(psize);
+  for (int r = 0; r < psize; r++) {
+    for (int c = 0; c < psize; c++) {
+      grid[r + 1][c + 1] = (n * (r % n) + r / n + c) % psize + 1;
+    }
+  }
+  return grid;
+}
+
+/**
+ * @brief Sets a random fraction of the cells to 0.
+ */
+void blankPuzzleCells(int psize, int **grid, double fraction, uint64_t seed) {
+  uint64_t state = seed | 1;
+  for (int row = 1; row <= psize; row++) {
+    for (int col = 1; col <= psize; col++) {
+      if ((rng_next(&state) >> 11) * (1.0 / 9007199254740992.0) < fraction) {
+        grid[row][col] = 0;
+      }
+    }
+  }
+}
+
+// Summary of repeated measurements of one benchmark
+typedef struct {
+  int n;          // Number of samples
+  double mean;    // Sample mean
+  double stddev;  // Sample standard deviation
+} bench_stats;
+
+/**
+ * @brief Computes mean and sample standard deviation.
+ */
+bench_stats compute_stats(const double *samples, int n) {
+  bench_stats st = {n, 0, 0};
+  for (int i = 0; i < n; i++) { st.mean += samples[i]; }
+  st.mean /= n;
+  for (int i = 0; i < n; i++) {
+    st.stddev += (samples[i] - st.mean) * (samples[i] - st.mean);
+  }
+  st.stddev = n > 1 ? sqrt(st.stddev / (n - 1)) : 0;
+  return st;
+}
+
+/**
+ * @brief Two-sided 95% critical value of Student's t distribution.
+ * @param df Degrees of freedom; values above 30 use the normal value.
+ */
+double t_critical_95(double df) {
+  static const double table[31] = {
+      0,     12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+      2.228, 2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+      2.086, 2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+      2.042};
+  int d = (int)df;
+  if (d < 1) { d = 1; }
+  return d <= 30 ? table[d] : 1.960;
+}
+
+/**
+ * @brief Probability that |T| is at least t, for T Student-distributed with
+ * df degrees of freedom (Abramowitz and Stegun 26.7.3 and 26.7.4).
+ */
+double t_two_sided_p(double t, int df) {
+  double theta = atan(fabs(t) / sqrt(df));
+  double c2 = cos(theta) * cos(theta), term = 1, sum = 1;
+  for (int k = df % 2 == 1 ? 3 : 2; k <= df - 2; k += 2) {
+    term *= c2 * (k - 1) / k;
+    sum += term;
+  }
+  if (df % 2 == 0) { return 1 - sin(theta) * sum; }
+  double a = df == 1 ? theta : theta + sin(theta) * cos(theta) * sum;
+  return 1 - a / M_PI * 2;
+}
+
+/**
+ * @brief Two-sided critical value of Student's t distribution at level
+ * alpha, found by bisection.
+ */
+double t_critical(double alpha, int df) {
+  double lo = 0, hi = 1e6;
+  for (int i = 0; i < 100; i++) {
+    double mid = (lo + hi) / 2;
+    if (t_two_sided_p(mid, df) > alpha) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return hi;
+}
+
+/**
+ * @brief Half-width of the 95% confidence interval of the mean.
+ */
+double ci95(bench_stats st) {
+  return st.n > 1 ? t_critical_95(st.n - 1) * st.stddev / sqrt(st.n) : 0;
+}
+
+// --- Baseline Recording and Regression Gate ---
+
+/*
+ * Benchmark modes accept "--save FILE", "--add FILE" and "--compare FILE".
+ * Baseline files hold one "key name mean stddev runs" line per benchmark,
+ * where key identifies the machine and the build, so one file can hold
+ * baselines for several hosts and compilers and a run is only ever compared
+ * with its own kind.
+ *
+ * The samples of one process vary far less than the means of two processes
+ * do (placement of memory, clock speed, what else the host runs), so a
+ * baseline is built from whole runs: "--save" starts it from this run's
+ * means and each "--add" folds in the means of one more run. mean and
+ * stddev are those of the run means. A run is then a regression when its
+ * mean lies above the prediction interval of the baseline runs. The level
+ * of each interval is 5% divided by the number of baselines (Bonferroni),
+ * so that an unchanged build fails with at most 5% probability however
+ * many benchmarks a mode runs.
+ *
+ * When comparing, a benchmark without a baseline of at least two runs under
+ * this run's key, or a file that cannot be read, fails the run like a
+ * regression: a gate with nothing to compare against must not pass.
+ */
+
+// Smallest slowdown reported as a regression, even if significant
+#define REGRESSION_MIN_CHANGE 0.05
+
+typedef struct {
+  char name[128];
+  bench_stats stats;
+} bench_record;
+
+typedef struct {
+  const char *save_path;     // Baseline file to record into, or NULL
+  bool save_add;             // Fold this run into save_path's baselines
+  const char *compare_path;  // Baseline file to compare with, or NULL
+  char key[256];             // Machine and build key of this run
+  bench_record *records;     // Results of this run
+  int num_records;
+  int capacity;
+  bench_record *baselines;   // Baselines under this run's key
+  int num_baselines;
+  bool compare_read;         // The compare file could be read
+  int regressions;           // Significant slowdowns found so far
+  int missing;               // Benchmarks without a baseline
+} bench_recorder;
+
+/**
+ * @brief Replaces spaces and other separators so s can be one field.
+ */
+void sanitize_field(char *s) {
+  for (; *s != '\0'; s++) {
+    if (*s == ' ' || *s == '\t' || *s == '\n' || *s == '=') { *s = '_'; }
+  }
+}
+
+/**
+ * @brief Builds the "machine/build" key of this run.
+ * @details Machine: host name, CPU model and online CPU count. Build:
+ * compiler version and whether it optimized.
+ */
+void bench_key(char *key, size_t size) {
+  char host[64] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  char cpu[128] = "unknown";
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  if (fp != NULL) {
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      char *colon = strchr(line, ':');
+      if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+        snprintf(cpu, sizeof(cpu), "%s", colon + 2);
+        cpu[strcspn(cpu, "\n")] = '\0';
+        break;
+      }
+    }
+    fclose(fp);
+  }
+  char build[128];
+#ifdef __OPTIMIZE__
+  snprintf(build, sizeof(build), "cc-%s-opt", __VERSION__);
+#else
+  snprintf(build, sizeof(build), "cc-%s-noopt", __VERSION__);
+#endif
+  snprintf(key, size, "%s/%s/%ldcpu/%s", host, cpu,
+           sysconf(_SC_NPROCESSORS_ONLN), build);
+  sanitize_field(key);
+}
+
+/**
+ * @brief Reads the baselines under key from a baseline file.
+ * @return The number of baselines (malloc'd into *out), or -1 if the file
+ * cannot be read.
+ */
+int read_baselines(const char *path, const char *key, bench_record **out) {
+  *out = NULL;
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) { return -1; }
+  char line[512], lkey[256];
+  int n = 0, capacity = 0;
+  bench_record r;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#') { continue; }
+    if (sscanf(line, "%255s %127s %lf %lf %d", lkey, r.name, &r.stats.mean,
+               &r.stats.stddev, &r.stats.n) != 5 ||
+        strcmp(lkey, key) != 0) {
+      continue;
+    }
+    if (n == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      bench_record *grown =
+          (bench_record *)realloc(*out, capacity * sizeof(bench_record));
+      if (grown == NULL) { break; }
+      *out = grown;
+    }
+    (*out)[n++] = r;
+  }
+  fclose(fp);
+  return n;
+}
+
+/**
+ * @brief Takes --save and --compare out of a mode's arguments and reads the
+ * baselines to compare with.
+ * @details The remaining arguments are shifted down and *argc is updated, so
+ * each mode only sees its own options.
+ */
+void recorder_init(bench_recorder *rec, int *argc, char **argv) {
+  memset(rec, 0, sizeof(*rec));
+  bench_key(rec->key, sizeof(rec->key));
+  int kept = 0;
+  for (int i = 0; i < *argc; i++) {
+    if ((strcmp(argv[i], "--save") == 0 || strcmp(argv[i], "--add") == 0) &&
+        i + 1 < *argc) {
+      rec->save_add = strcmp(argv[i], "--add") == 0;
+      rec->save_path = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < *argc) {
+      rec->compare_path = argv[++i];
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  *argc = kept;
+  if (rec->compare_path != NULL) {
+    rec->num_baselines =
+        read_baselines(rec->compare_path, rec->key, &rec->baselines);
+    rec->compare_read = rec->num_baselines >= 0;
+    if (rec->num_baselines < 0) { rec->num_baselines = 0; }
+  }
+}
+
+/**
+ * @brief Looks up the baseline of one benchmark.
+ * @return true and fills *out if baselines has the benchmark.
+ */
+bool lookup_baseline(const bench_record *baselines, int num_baselines,
+                     const char *name, bench_stats *out) {
+  for (int i = 0; i < num_baselines; i++) {
+    if (strcmp(baselines[i].name, name) == 0) {
+      *out = baselines[i].stats;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Prints the header columns added by recorder_report.
+ */
+void recorder_header(const bench_recorder *rec) {
+  if (rec->compare_path != NULL) {
+    printf(" %10s %8s %s", "baseline", "change", "verdict");
+  }
+  printf("\n");
+}
+
+/**
+ * @brief Records one result and, when comparing, prints the change.
+ * @details A slowdown is a regression when the run's mean lies above the
+ * prediction interval of the baseline's run means (see the section comment)
+ * and the change is at least REGRESSION_MIN_CHANGE. The spread of the run's own samples only
+ * widens the interval. A benchmark whose baseline has fewer than two runs is marked and
+ * counted as missing. Does not end the line.
+ */
+void recorder_report(bench_recorder *rec, const char *name, bench_stats st) {
+  if (rec->num_records == rec->capacity) {
+    rec->capacity = rec->capacity ? 2 * rec->capacity : 64;
+    rec->records = (bench_record *)realloc(
+        rec->records, rec->capacity * sizeof(bench_record));
+  }
+  bench_record *r = &rec->records[rec->num_records++];
+  snprintf(r->name, sizeof(r->name), "%s", name);
+  r->stats = st;
+
+  bench_stats base;
+  if (rec->compare_path == NULL) { return; }
+  if (!lookup_baseline(rec->baselines, rec->num_baselines, name, &base) ||
+      base.n < 2) {
+    printf(" %10s %8s %s", "-", "-", "NO-BASELINE");
+    rec->missing++;
+    return;
+  }
+  double change = (st.mean - base.mean) / base.mean;
+  // Prediction interval of one more run mean, widened by the uncertainty of
+  // this run's mean when a burst of interference made its samples noisy
+  double own = st.n > 1 ? st.stddev * st.stddev / st.n : 0;
+  double half = t_critical(0.05 / rec->num_baselines, base.n - 1) *
+                sqrt(base.stddev * base.stddev * (1 + 1.0 / base.n) + own);
+  bool significant = fabs(st.mean - base.mean) > half;
+  const char *verdict = "";
+  if (significant && change >= REGRESSION_MIN_CHANGE) {
+    verdict = "REGRESSION";
+    rec->regressions++;
+  } else if (significant && change <= -REGRESSION_MIN_CHANGE) {
+    verdict = "faster";
+  }
+  printf(" %10.3g %+7.1f%% %s", base.mean, change * 100, verdict);
+}
+
+/**
+ * @brief Writes the baseline file if saving and summarizes the comparison.
+ * @details Saving keeps lines of other keys and of benchmarks this run did not
+ * measure, and replaces the rest: with --save by this run's means, with --add
+ * by the old baseline with this run's means folded in.
+ * @return EXIT_FAILURE if any regression was found, a benchmark had no
+ * baseline, the compare file could not be read or the save file could not be
+ * written; EXIT_SUCCESS otherwise.
+ */
+int recorder_finish(bench_recorder *rec) {
+  int status = EXIT_SUCCESS;
+  if (rec->save_path != NULL) {
+    // Read the old file first; it is rewritten in place
+    bench_record *old = NULL;
+    int num_old =
+        rec->save_add ? read_baselines(rec->save_path, rec->key, &old) : 0;
+    char **kept = NULL;
+    int num_kept = 0;
+    FILE *fp = fopen(rec->save_path, "r");
+    char line[512], key[256], bname[128];
+    while (fp != NULL && fgets(line, sizeof(line), fp) != NULL) {
+      bool replaced = false;
+      if (sscanf(line, "%255s %127s", key, bname) == 2 &&
+          strcmp(key, rec->key) == 0) {
+        for (int i = 0; i < rec->num_records && !replaced; i++) {
+          replaced = strcmp(rec->records[i].name, bname) == 0;
+        }
+      }
+      if (!replaced) {
+        kept = (char **)realloc(kept, (num_kept + 1) * sizeof(char *));
+        kept[num_kept++] = strdup(line);
+      }
+    }
+    if (fp != NULL) { fclose(fp); }
+    fp = fopen(rec->save_path, "w");
+    if (fp == NULL) {
+      printf("Could not open file %s\n", rec->save_path);
+      status = EXIT_FAILURE;
+    }
+    for (int i = 0; i < num_kept; i++) {
+      if (fp != NULL) { fputs(kept[i], fp); }
+      free(kept[i]);
+    }
+    free(kept);
+    for (int i = 0; fp != NULL && i < rec->num_records; i++) {
+      bench_record *r = &rec->records[i];
+      bench_stats b = {1, r->stats.mean, 0};
+      bench_stats prev;
+      if (lookup_baseline(old, num_old, r->name, &prev)) {
+        // Welford's update of the run means with this run's mean
+        double m2 = prev.stddev * prev.stddev * (prev.n - 1);
+        b.n = prev.n + 1;
+        b.mean = prev.mean + (r->stats.mean - prev.mean) / b.n;
+        m2 += (r->stats.mean - prev.mean) * (r->stats.mean - b.mean);
+        b.stddev = sqrt(m2 / (b.n - 1));
+      }
+      fprintf(fp, "%s %s %.6g %.6g %d\n", rec->key, r->name, b.mean, b.stddev,
+              b.n);
+    }
+    if (fp != NULL) { fclose(fp); }
+    free(old);
+  }
+  if (rec->compare_path != NULL && !rec->compare_read) {
+    printf("# Could not read baseline file %s\n", rec->compare_path);
+    status = EXIT_FAILURE;
+  } else if (rec->compare_path != NULL) {
+    printf("# %d regression(s), %d benchmark(s) without a baseline against "
+           "%s\n",
+           rec->regressions, rec->missing, rec->compare_path);
+    if (rec->regressions > 0 || rec->missing > 0) { status = EXIT_FAILURE; }
+  }
+  free(rec->records);
+  free(rec->baselines);
+  return status;
+}
+
+// --- Scaling Benchmark ---
+
+enum { PHASE_VALIDATE, PHASE_FILL, PHASE_FULL, PHASE_BANDS, NUM_PHASES };
+const char *phase_names[NUM_PHASES] = {"validate", "fill-in", "full", "bands"};
+
+/**
+ * @brief Times one phase on a copy of start.
+ * @details The copy is refreshed before every call and is not timed. Runs 8
+ * trials of enough calls to take about 10 ms each.
+ * @param num_threads Thread count, or 0 to time checkPuzzle itself
+ * (psize + 2 threads).
+ * @param st Output: statistics of the per-trial seconds per call.
+ * @return Median seconds per call.
+ */
+double time_phase(int phase, int psize, int **start, int **work,
+                  int num_threads, bench_stats *st) {
+  enum { TRIALS = 8 };
+  double trials[TRIALS];
+  int reps = 1;
+  for (int t = 0; t < TRIALS; t++) {
+    double elapsed = 0;
+    for (int i = 0; i < reps; i++) {
+      copySudokuPuzzle(psize, work, start);
+      bool complete, valid;
+      double t0 = now_seconds();
+      if (num_threads == 0) {
+        checkPuzzle(psize, work, &complete, &valid);
+      } else if (phase == PHASE_VALIDATE) {
+        validatePuzzleThreads(psize, work, num_threads);
+      } else if (phase == PHASE_FILL) {
+        fillPuzzleThreads(psize, work, num_threads);
+      } else if (phase == PHASE_BANDS) {
+        fillPuzzleBands(psize, work, num_threads);
+      } else {
+        checkPuzzleThreads(psize, work, num_threads, &complete, &valid);
+      }
+      elapsed += now_seconds() - t0;
+    }
+    if (t == 0 && elapsed < 0.01) {
+      // Calibrate on the first trial and redo it with more reps
+      reps = (int)(0.01 / (elapsed > 1e-7 ? elapsed : 1e-7) * reps) + 1;
+      t--;
+      continue;
+    }
+    trials[t] = elapsed / reps;
+  }
+  *st = compute_stats(trials, TRIALS);
+  // Median by insertion sort; TRIALS is tiny
+  for (int i = 1; i < TRIALS; i++) {
+    for (int j = i; j > 0 && trials[j] < trials[j - 1]; j--) {
+      double tmp = trials[j];
+      trials[j] = trials[j - 1];
+      trials[j - 1] = tmp;
+    }
+  }
+  return trials[TRIALS / 2];
+}
+
+/**
+ * @brief Sweeps thread counts and board sizes for validation, fill-in and the
+ * full check, and prints strong and weak scaling efficiency.
+ * @details Strong scaling: speedup T(1) / T(p) on a fixed board, efficiency
+ * speedup / p. Weak scaling: for p threads the board whose cell count is
+ * closest to p times the base board's is timed, and the efficiency is the
+ * per-cell single-thread time divided by the per-cell-per-thread time.
+ * Validation uses complete boards; fill-in, full and bands (fill-in split
+ * into bands, fillPuzzleBands) use boards with 30% of the cells blanked.
+ * Bands cap the thread count at sqrt(psize), so their rows beyond that
+ * repeat the capped time.
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional max thread count (default: online CPUs, at least 4)
+ * and optional max board size (default 100), plus the baseline options.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or regressions.
+ */
+int runScalingBenchmark(int argc, char **argv) {
+  bench_recorder rec;
+  recorder_init(&rec, &argc, argv);
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_threads < 4) { max_threads = 4; }
+  int max_size = 100;
+  if (argc > 0) { max_threads = atoi(argv[0]); }
+  if (argc > 1) { max_size = atoi(argv[1]); }
+  if (max_threads < 1 || max_size < 4) {
+    printf("usage: ./sudoku --bench-scaling [max_threads] [max_size] "
+           "[--save|--add FILE] [--compare FILE]\n");
+    return EXIT_FAILURE;
+  }
+
+  int sizes[64];
+  int num_sizes = 0;
+  for (int n = 2; n * n <= max_size && num_sizes < 64; n++) {
+    sizes[num_sizes++] = n * n;
+  }
+  // times[size][threads][phase]; threads index 0 is checkPuzzle itself
+  double *times = (double *)malloc(num_sizes * (max_threads + 1) * NUM_PHASES *
+                                   sizeof(double));
+#define TIME_AT(s, t, ph) times[((s) * (max_threads + 1) + (t)) * NUM_PHASES + (ph)]
+
+  printf("# scaling: threads 1..%d, sizes %d..%d\n", max_threads, sizes[0],
+         sizes[num_sizes - 1]);
+  printf("%-9s %5s %7s %12s %8s %10s", "phase", "size", "threads", "time_us",
+         "speedup", "strong_eff");
+  recorder_header(&rec);
+  for (int s = 0; s < num_sizes; s++) {
+    int psize = sizes[s];
+    int **solved = makeSolvedPuzzle(psize);
+    int **blanked = makeSolvedPuzzle(psize);
+    blankPuzzleCells(psize, blanked, 0.3, 0x5eed + psize);
+    int **work = allocSudokuPuzzle(psize);
+    for (int ph = 0; ph < NUM_PHASES; ph++) {
+      int **start = ph == PHASE_VALIDATE ? solved : blanked;
+      for (int t = 1; t <= max_threads; t++) {
+        bench_stats st;
+        double sec = time_phase(ph, psize, start, work, t, &st);
+        TIME_AT(s, t, ph) = sec;
+        double speedup = TIME_AT(s, 1, ph) / sec;
+        printf("%-9s %5d %7d %12.2f %8.2f %10.2f", phase_names[ph], psize, t,
+               sec * 1e6, speedup, speedup / t);
+        char name[128];
+        snprintf(name, sizeof(name), "scaling/%s/%d/t%d", phase_names[ph],
+                 psize, t);
+        // Record the median, as printed: a burst of interference on a busy
+        // host moves it less than the mean, so whole runs agree better
+        st.mean = sec;
+        recorder_report(&rec, name, st);
+        printf("\n");
+      }
+    }
+    // The current layout, for comparison with the sweep
+    bench_stats st;
+    double sec = time_phase(PHASE_FULL, psize, blanked, work, 0, &st);
+    TIME_AT(s, 0, PHASE_FULL) = sec;
+    printf("%-9s %5d %7s %12.2f %8.2f %10.2f", "full", psize, "psize+2",
+           sec * 1e6, TIME_AT(s, 1, PHASE_FULL) / sec,
+           TIME_AT(s, 1, PHASE_FULL) / sec / (psize + 2));
+    char name[128];
+    snprintf(name, sizeof(name), "scaling/full/%d/checkPuzzle", psize);
+    st.mean = sec;
+    recorder_report(&rec, name, st);
+    printf("\n");
+    deleteSudokuPuzzle(psize, solved);
+    deleteSudokuPuzzle(psize, blanked);
+    deleteSudokuPuzzle(psize, work);
+  }
+
+  int base = 0;
+  while (base + 1 < num_sizes && sizes[base] < 9) { base++; }
+  printf("\n# weak scaling, base size %d\n", sizes[base]);
+  printf("%-9s %7s %5s %12s %8s\n", "phase", "threads", "size", "time_us",
+         "weak_eff");
+  for (int ph = 0; ph < NUM_PHASES; ph++) {
+    double base_cells = (double)sizes[base] * sizes[base];
+    double base_per_cell = TIME_AT(base, 1, ph) / base_cells;
+    for (int t = 1; t <= max_threads; t++) {
+      int best = base;
+      for (int s = 0; s < num_sizes; s++) {
+        double want = base_cells * t;
+        double have = (double)sizes[s] * sizes[s];
+        double cur = (double)sizes[best] * sizes[best];
+        if (fabs(have - want) < fabs(cur - want)) { best = s; }
+      }
+      double cells = (double)sizes[best] * sizes[best];
+      double sec = TIME_AT(best, t, ph);
+      printf("%-9s %7d %5d %12.2f %8.2f\n", phase_names[ph], t, sizes[best],
+             sec * 1e6, base_per_cell / (sec / (cells / t)));
+    }
+  }
+#undef TIME_AT
+  free(times);
+  return recorder_finish(&rec);
+}
+
+// --- Host Autotuner ---
+
+/*
+ * "--autotune" times validation, fill-in and search on generated boards of
+ * each size for a range of thread counts on this host. It also decides
+ * whether fill-in goes by units (rows, columns, subgrids) or by bands. It
+ * writes the fastest settings to a tuning profile, one line per size:
+ *
+ *   size validate_threads fill_mode fill_threads search_threads
+ *
+ * A solve loads a profile only when given one with --profile, so a stray
+ * file in the working directory never changes a run. checkPuzzle and
+ * search_default_options then use the entry for the nearest profiled size
+ * instead of their built-in choices: psize + 2 threads, bands from
+ * BAND_MIN_PSIZE, one search task below 16x16. Benchmarks never load a
+ * profile, so they keep measuring the built-in choices. Without a profile
+ * nothing changes.
+ */
+
+#define TUNE_PROFILE_DEFAULT "tune-profile.txt"
+// Search runtimes on random boards are heavy-tailed; timed searches are
+// capped at this many nodes per task
+#define TUNE_SEARCH_NODES 5000
+
+const char *fill_mode_names[] = {"units", "bands"};
+
+/**
+ * @brief Loads a tuning profile.
+ * @return false if the file cannot be opened or is not a tuning profile.
+ */
+bool loadTuneProfile(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) { return false; }
+  char line[256], mode[16];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') { continue; }
+    tune_entry e;
+    ok = sscanf(line, "%d %d %15s %d %d", &e.psize, &e.validate_threads, mode,
+                &e.fill_threads, &e.search_threads) == 5 &&
+         e.psize > 0 && e.validate_threads > 0 && e.fill_threads > 0 &&
+         e.search_threads > 0;
+    e.fill_bands = strcmp(mode, fill_mode_names[1]) == 0;
+    ok = ok && (e.fill_bands || strcmp(mode, fill_mode_names[0]) == 0);
+    if (ok) {
+      tune_entries = (tune_entry *)realloc(
+          tune_entries, (num_tune_entries + 1) * sizeof(tune_entry));
+      tune_entries[num_tune_entries++] = e;
+    }
+  }
+  fclose(fp);
+  if (!ok) {
+    free(tune_entries);
+    tune_entries = NULL;
+    num_tune_entries = 0;
+  }
+  return ok;
+}
+
+/**
+ * @brief Returns the profile entry of the profiled size nearest to psize
+ * (the smaller one on a tie), or NULL if no profile is loaded.
+ */
+const tune_entry *tune_lookup(int psize) {
+  const tune_entry *best = NULL;
+  for (int i = 0; i < num_tune_entries; i++) {
+    const tune_entry *e = &tune_entries[i];
+    int d = abs(e->psize - psize), bd = best ? abs(best->psize - psize) : 0;
+    if (best == NULL || d < bd || (d == bd && e->psize < best->psize)) {
+      best = e;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Times the search on a copy of start.
+ * @details Median of 5 trials, each of enough solves to take about 10 ms.
+ * @return Median seconds per solve.
+ */
+double time_search(int psize, int **start, int **work, int num_threads) {
+  enum { TRIALS = 5 };
+  double trials[TRIALS];
+  search_options opts = search_default_options(psize);
+  opts.threads = num_threads;
+  opts.max_nodes = TUNE_SEARCH_NODES;
+  int reps = 1;
+  for (int t = 0; t < TRIALS; t++) {
+    double elapsed = 0;
+    for (int i = 0; i < reps; i++) {
+      copySudokuPuzzle(psize, work, start);
+      double t0 = now_seconds();
+      solvePuzzleSearch(psize, work, &opts, NULL);
+      elapsed += now_seconds() - t0;
+    }
+    if (t == 0 && elapsed < 0.01) {
+      reps = (int)(0.01 / (elapsed > 1e-7 ? elapsed : 1e-7) * reps) + 1;
+      t--;
+      continue;
+    }
+    trials[t] = elapsed / reps;
+  }
+  for (int i = 1; i < TRIALS; i++) {
+    for (int j = i; j > 0 && trials[j] < trials[j - 1]; j--) {
+      double tmp = trials[j];
+      trials[j] = trials[j - 1];
+      trials[j - 1] = tmp;
+    }
+  }
+  return trials[TRIALS / 2];
+}
+
+/**
+ * @brief Measures the host and writes a tuning profile.
+ * @details For each size n * n up to max_size, tries 1, 2, 4, ... threads
+ * up to max_threads. Validation runs on a complete board, fill-in (units
+ * and bands) on one with 30% of the cells blanked, as in --bench-scaling.
+ * The search runs on the first of a few boards with 40% blanked that one
+ * task solves within TUNE_SEARCH_NODES (the fill-in board if none does).
+ * A setting replaces a smaller
+ * thread count only if it is at least 5% faster, since more threads cost
+ * more on a busy host. Prints the chosen settings and their speedup over
+ * the built-in choices.
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional max board size (default 100) and max thread count
+ * (default: twice the online CPUs), plus "--profile FILE".
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or if the profile
+ * cannot be written.
+ */
+int runAutotune(int argc, char **argv) {
+  const char *path = TUNE_PROFILE_DEFAULT;
+  int kept = 0;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      path = argv[++i];
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  int max_size = argc > 0 ? atoi(argv[0]) : 100;
+  int max_threads = argc > 1 ? atoi(argv[1])
+                             : 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc > 2 || max_size < 4 || max_threads < 1) {
+    printf("usage: ./sudoku --autotune [max_size] [max_threads] "
+           "[--profile FILE]\n");
+    return EXIT_FAILURE;
+  }
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    printf("Could not open file %s\n", path);
+    return EXIT_FAILURE;
+  }
+  char key[256];
+  bench_key(key, sizeof(key));
+  fprintf(fp, "# sudoku tuning profile for %s\n", key);
+  fprintf(fp, "# size validate_threads fill_mode fill_threads "
+              "search_threads\n");
+  printf("%5s %9s %11s %7s %10s %10s %10s\n", "size", "validate", "fill",
+         "search", "check_us", "builtin_us", "speedup");
+  for (int n = 2; n * n <= max_size; n++) {
+    int psize = n * n;
+    int **solved = makeSolvedPuzzle(psize);
+    int **blanked = makeSolvedPuzzle(psize);
+    blankPuzzleCells(psize, blanked, 0.3, 0x5eed + psize);
+    int **sparse = makeSolvedPuzzle(psize);
+    int **work = allocSudokuPuzzle(psize);
+    search_options probe = search_default_options(psize);
+    probe.threads = 1;
+    probe.max_nodes = TUNE_SEARCH_NODES;
+    bool found = false;
+    for (int seed = 0; seed < 8 && !found; seed++) {
+      copySudokuPuzzle(psize, sparse, solved);
+      blankPuzzleCells(psize, sparse, 0.4, 0x5eed + psize + seed);
+      copySudokuPuzzle(psize, work, sparse);
+      found = solvePuzzleSearch(psize, work, &probe, NULL) == SEARCH_SOLVED;
+    }
+    if (!found) { copySudokuPuzzle(psize, sparse, blanked); }
+    bench_stats st;
+    tune_entry e = {psize, 1, 1, false, 1};
+    double best_validate = 0, best_fill = 0, best_search = 0;
+    for (int t = 1; t <= max_threads; t *= 2) {
+      double sec = t > 3 * psize
+                       ? 1e30
+                       : time_phase(PHASE_VALIDATE, psize, solved, work, t, &st);
+      if (t == 1 || sec < 0.95 * best_validate) {
+        best_validate = sec;
+        e.validate_threads = t;
+      }
+      sec = t > 3 * psize ? 1e30
+                          : time_phase(PHASE_FILL, psize, blanked, work, t, &st);
+      if (t == 1 || sec < 0.95 * best_fill) {
+        best_fill = sec;
+        e.fill_threads = t;
+        e.fill_bands = false;
+      }
+      if (t <= n) {
+        sec = time_phase(PHASE_BANDS, psize, blanked, work, t, &st);
+        if (sec < 0.95 * best_fill) {
+          best_fill = sec;
+          e.fill_threads = t;
+          e.fill_bands = true;
+        }
+      }
+      sec = time_search(psize, sparse, work, t);
+      if (t == 1 || sec < 0.95 * best_search) {
+        best_search = sec;
+        e.search_threads = t;
+      }
+    }
+    // The built-in check: psize + 2 threads, bands from BAND_MIN_PSIZE
+    double builtin = time_phase(PHASE_FULL, psize, blanked, work, 0, &st);
+    double tuned = best_fill + best_validate;
+    char fill[16];
+    snprintf(fill, sizeof(fill), "%s/%d", fill_mode_names[e.fill_bands],
+             e.fill_threads);
+    printf("%5d %9d %11s %7d %10.1f %10.1f %10.2f\n", psize,
+           e.validate_threads, fill, e.search_threads, tuned * 1e6,
+           builtin * 1e6, builtin / tuned);
+    fprintf(fp, "%d %d %s %d %d\n", psize, e.validate_threads,
+            fill_mode_names[e.fill_bands], e.fill_threads, e.search_threads);
+    deleteSudokuPuzzle(psize, solved);
+    deleteSudokuPuzzle(psize, blanked);
+    deleteSudokuPuzzle(psize, sparse);
+    deleteSudokuPuzzle(psize, work);
+  }
+  if (fclose(fp) != 0) {
+    printf("Could not write file %s\n", path);
+    return EXIT_FAILURE;
+  }
+  printf("Wrote %s\n", path);
+  return EXIT_SUCCESS;
+}
+
+// --- Kernel Microbenchmarks ---
+
+/**
+ * @brief Reads the CPU cycle counter, or nanoseconds where there is none.
+ */
+uint64_t read_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLE_UNIT "cycles"
+#else
+#define CYCLE_UNIT "ns"
+#endif
+
+/*
+ * Each kernel wrapper runs one validation or solve helper over all psize units
+ * of that kind in the grid, so one call touches every cell once.
+ */
+
+int kernel_row_valid(int psize, int **grid) {
+  int ok = 0;
+  for (int i = 1; i <= psize; i++) { ok += is_row_valid(i, psize, grid); }
+  return ok;
+}
+
+int kernel_col_valid(int psize, int **grid) {
+  int ok = 0;
+  for (int i = 1; i <= psize; i++) { ok += is_col_valid(i, psize, grid); }
+  return ok;
+}
+
+int kernel_subgrid_valid(int psize, int **grid) {
+  int n = sqrt(psize);
+  int ok = 0;
+  for (int r = 1; r <= psize; r += n) {
+    for (int c = 1; c <= psize; c += n) {
+      ok += is_subgrid_valid(r, c, psize, grid);
+    }
+  }
+  return ok;
+}
+
+/**
+ * @brief Empties one cell of every row, column and subgrid of a complete
+ * board: cell (r, (r % n) * n + r / n) for n = sqrt(psize).
+ * @details The solve kernels call it first and then fill the cells back, so
+ * they run the fill path on boards that end up complete again, as the
+ * validation kernels need them. It writes psize cells, 1/psize of what the
+ * kernel reads.
+ */
+void bench_blank(int psize, int **grid) {
+  int n = sqrt(psize);
+  for (int r = 0; r < psize; r++) { grid[r + 1][(r % n) * n + r / n + 1] = 0; }
+}
+
+int kernel_solve_row(int psize, int **grid) {
+  bench_blank(psize, grid);
+  int filled = 0;
+  for (int i = 1; i <= psize; i++) { filled += solve_row(i, psize, grid); }
+  return filled;
+}
+
+int kernel_solve_col(int psize, int **grid) {
+  bench_blank(psize, grid);
+  int filled = 0;
+  for (int i = 1; i <= psize; i++) { filled += solve_col(i, psize, grid); }
+  return filled;
+}
+
+int kernel_solve_subgrid(int psize, int **grid) {
+  bench_blank(psize, grid);
+  int n = sqrt(psize);
+  int filled = 0;
+  for (int r = 1; r <= psize; r += n) {
+    for (int c = 1; c <= psize; c += n) {
+      filled += solve_subgrid(r, c, psize, grid);
+    }
+  }
+  return filled;
+}
+
+/*
+ * The 9x9 permutation validators, one wrapper per unit kind and method, to
+ * compare with is_*_valid/9.
+ */
+
+int kernel_perm9(int **grid, int kind, bool table) {
+  int ok = 0;
+  for (int u = 0; u < 9; u++) {
+    ok += table ? perm9_table_valid(grid, kind, u)
+                : perm9_mask_valid(grid, kind, u);
+  }
+  return ok;
+}
+
+int kernel_perm9_table_row(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_ROW, true);
+}
+
+int kernel_perm9_table_col(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_COL, true);
+}
+
+int kernel_perm9_table_box(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_BOX, true);
+}
+
+int kernel_perm9_mask_row(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_ROW, false);
+}
+
+int kernel_perm9_mask_col(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_COL, false);
+}
+
+int kernel_perm9_mask_box(int psize, int **grid) {
+  (void)psize;
+  return kernel_perm9(grid, UNIT_BOX, false);
+}
+
+typedef struct {
+  const char *name;
+  int (*run)(int psize, int **grid);
+  int only_psize; // Runs only on this board size; 0 for every size
+} bench_kernel;
+
+bench_kernel bench_kernels[] = {
+    {"is_row_valid", kernel_row_valid, 0},
+    {"is_col_valid", kernel_col_valid, 0},
+    {"is_subgrid_valid", kernel_subgrid_valid, 0},
+    {"solve_row", kernel_solve_row, 0},
+    {"solve_col", kernel_solve_col, 0},
+    {"solve_subgrid", kernel_solve_subgrid, 0},
+    {"perm9_table_row", kernel_perm9_table_row, 9},
+    {"perm9_table_col", kernel_perm9_table_col, 9},
+    {"perm9_table_box", kernel_perm9_table_box, 9},
+    {"perm9_mask_row", kernel_perm9_mask_row, 9},
+    {"perm9_mask_col", kernel_perm9_mask_col, 9},
+    {"perm9_mask_box", kernel_perm9_mask_box, 9},
+};
+#define NUM_BENCH_KERNELS (int)(sizeof(bench_kernels) / sizeof(bench_kernels[0]))
+
+// Total size of the board set cycled through in the cache-cold runs; larger
+// than the last-level cache of the machines we run on.
+#define COLD_SET_BYTES (64 * 1024 * 1024)
+#define MICRO_SAMPLES 20
+
+// Sink for kernel results so the calls are not optimized away
+volatile int bench_sink;
+
+/**
+ * @brief Times one kernel over a set of boards.
+ * @details Boards are visited in the order given, so with one board the data
+ * stays in cache and with a set larger than the cache every call misses;
+ * the order is shuffled so the prefetcher cannot run ahead to the next
+ * board. Solve kernels blank one cell per unit and fill them back (see
+ * bench_blank).
+ * @param order Visiting order of the boards, a permutation of num_boards.
+ * @param next Position in order, carried between kernels so that a cold
+ * run never revisits a board another kernel just touched.
+ * @param samples Output array of MICRO_SAMPLES cycles-per-cell values.
+ */
+void sample_kernel(const bench_kernel *k, int psize, int **boards[],
+                   const int *order, int num_boards, int *next,
+                   double *samples) {
+  // Enough calls per sample to take ~100k cycles. A cold set is never
+  // wrapped around within the samples, so every board it visits is a miss.
+  long calls = 100000 / ((long)psize * psize) + 1;
+  int sink = 0;
+  for (int s = -1; s < MICRO_SAMPLES; s++) { // Sample -1 is a discarded warmup
+    uint64_t c0 = read_cycles();
+    for (long i = 0; i < calls; i++) {
+      sink += k->run(psize, boards[order[*next]]);
+      if (++*next == num_boards) { *next = 0; }
+    }
+    uint64_t c1 = read_cycles();
+    if (s >= 0) {
+      samples[s] = (double)(c1 - c0) / ((double)calls * psize * psize);
+    }
+  }
+  bench_sink = sink;
+}
+
+/**
+ * @brief Runs every kernel on cache-resident and cache-cold boards of each
+ * size and prints cycles per cell with a 95% confidence interval.
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional max board size (default 100), plus the baseline
+ * options.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or regressions.
+ */
+int runMicroBenchmark(int argc, char **argv) {
+  bench_recorder rec;
+  recorder_init(&rec, &argc, argv);
+  int max_size = argc > 0 ? atoi(argv[0]) : 100;
+  if (max_size < 4 || argc > 1) {
+    printf("usage: ./sudoku --microbench [max_size] [--save|--add FILE] "
+           "[--compare FILE]\n");
+    return EXIT_FAILURE;
+  }
+  printf("# %s per cell, %d samples, 95%% CI\n", CYCLE_UNIT, MICRO_SAMPLES);
+  printf("%-36s %10s %8s", "benchmark", "mean", "ci95");
+  recorder_header(&rec);
+  for (int n = 2; n * n <= max_size; n++) {
+    int psize = n * n;
+    size_t board_bytes = (psize + 1) * (sizeof(int *) + (psize + 1) * sizeof(int));
+    long calls = 100000 / ((long)psize * psize) + 1;
+    int num_cold = COLD_SET_BYTES / board_bytes + 1;
+    if (num_cold > calls * (MICRO_SAMPLES + 1) * NUM_BENCH_KERNELS) {
+      // Beyond this no board is visited twice, so more would only cost time
+      num_cold = calls * (MICRO_SAMPLES + 1) * NUM_BENCH_KERNELS;
+    }
+    int ***boards = (int ***)malloc(num_cold * sizeof(int **));
+    int *order = (int *)malloc(num_cold * sizeof(int));
+    uint64_t rng = 0x9E3779B97F4A7C15ULL ^ psize;
+    for (int b = 0; b < num_cold; b++) {
+      boards[b] = makeSolvedPuzzle(psize);
+      // Inside-out Fisher-Yates shuffle
+      int j = (int)(rng_next(&rng) % (uint64_t)(b + 1));
+      order[b] = order[j];
+      order[j] = b;
+    }
+
+    int next = 0;
+    for (int cold = 0; cold <= 1; cold++) {
+      for (int k = 0; k < NUM_BENCH_KERNELS; k++) {
+        if (bench_kernels[k].only_psize && bench_kernels[k].only_psize != psize) {
+          continue;
+        }
+        double samples[MICRO_SAMPLES];
+        if (!cold) { next = 0; }
+        sample_kernel(&bench_kernels[k], psize, boards, order,
+                      cold ? num_cold : 1, &next, samples);
+        bench_stats st = compute_stats(samples, MICRO_SAMPLES);
+        char name[256];
+        snprintf(name, sizeof(name), "%s/%d/%s", bench_kernels[k].name, psize,
+                 cold ? "cold" : "hot");
+        printf("%-36s %10.3f %8.3f", name, st.mean, ci95(st));
+        recorder_report(&rec, name, st);
+        printf("\n");
+      }
+    }
+    for (int b = 0; b < num_cold; b++) { deleteSudokuPuzzle(psize, boards[b]); }
+    free(boards);
+    free(order);
+  }
+  return recorder_finish(&rec);
+}
+
+// --- Huge Page Benchmark ---
+
+/**
+ * @brief Opens a dTLB load-miss counter for this thread.
+ * @return The counter fd, or -1 if perf events are unavailable.
+ */
+int open_dtlb_counter(void) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+/**
+ * @brief Solves large generated boards with and without huge pages and
+ * prints time and dTLB load misses for each.
+ * @details Uses one search task so the counter (which follows only the
+ * calling thread) sees all the work. Boards are complete boards with 20% of
+ * the cells blanked, so the search touches the grid, candidate bitsets and
+ * snapshots of the whole board. (Much denser blanking makes the search time
+ * heavy-tailed, which would swamp the memory effect being measured.)
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional board sizes (default 144 and 256).
+ * @return EXIT_SUCCESS or EXIT_FAILURE on bad arguments.
+ */
+int runHugePageBenchmark(int argc, char **argv) {
+  int default_sizes[] = {144, 256};
+  int num_sizes = argc > 0 ? argc : 2;
+  printf("%-6s %-8s %-8s %10s %14s\n", "size", "pages", "arena", "time_ms",
+         "dtlb_misses");
+  for (int i = 0; i < num_sizes; i++) {
+    int psize = argc > 0 ? atoi(argv[i]) : default_sizes[i];
+    int n = sqrt(psize);
+    if (psize < 4 || n * n != psize) {
+      printf("usage: ./sudoku --bench-hugepages [size ...] (square sizes)\n");
+      return EXIT_FAILURE;
+    }
+    for (int huge = 0; huge <= 1; huge++) {
+      huge_pages_enabled = huge;
+      int **grid = makeSolvedPuzzle(psize);
+      blankPuzzleCells(psize, grid, 0.2, 0x5eed + psize);
+      // Shows what backing the solver's arena chunks actually get
+      void *probe = hugeAlloc(1, psize >= HUGE_PAGE_MIN_PSIZE);
+      const char *kind = mem_kind_names[hugeKind(probe)];
+      hugeFree(probe);
+      search_options opts = search_default_options(psize);
+      opts.threads = 1;
+      int fd = open_dtlb_counter();
+      long long misses = -1;
+#ifdef __linux__
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+      double t0 = now_seconds();
+      solvePuzzleSearch(psize, grid, &opts, NULL);
+      double ms = (now_seconds() - t0) * 1e3;
+#ifdef __linux__
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+          misses = -1;
+        }
+        close(fd);
+      }
+#endif
+      printf("%-6d %-8s %-8s %10.2f ", psize, huge ? "huge" : "4k", kind, ms);
+      if (misses >= 0) {
+        printf("%14lld\n", misses);
+      } else {
+        printf("%14s\n", "n/a");
+      }
+      deleteSudokuPuzzle(psize, grid);
+    }
+  }
+  huge_pages_enabled = true;
+  return EXIT_SUCCESS;
+}
+
+// --- Tokenizer Benchmark ---
+
+/**
+ * @brief Parses a generated buffer of large boards with the tokenizer and
+ * with fscanf, and prints the throughput of each.
+ * @details The buffer holds 256x256 boards (values up to three digits) in
+ * the puzzle file format. fscanf reads through fmemopen on at most 16 MB, as
+ * it is far slower. Reports the best of 5 passes.
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional buffer size in MB (default 256).
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or a parse error.
+ */
+int runTokenizerBenchmark(int argc, char **argv) {
+  long mb = argc > 0 ? atol(argv[0]) : 256;
+  if (mb < 1) {
+    printf("usage: ./sudoku --bench-tokenizer [MB]\n");
+    return EXIT_FAILURE;
+  }
+  size_t cap = (size_t)mb * 1024 * 1024;
+  char *buf = (char *)malloc(cap + 16);
+  int psize = 256;
+  int **board = makeSolvedPuzzle(psize);
+  size_t len = 0;
+  long long expected = 0; // Sum of all integers in the buffer
+  while (len + (size_t)psize * psize * 4 + 16 < cap) {
+    len += sprintf(buf + len, "%d\n", psize);
+    expected += psize;
+    for (int r = 1; r <= psize; r++) {
+      for (int c = 1; c <= psize; c++) {
+        len += sprintf(buf + len, c < psize ? "%d " : "%d\n", board[r][c]);
+        expected += board[r][c];
+      }
+    }
+  }
+  deleteSudokuPuzzle(psize, board);
+
+  double best = 1e30;
+  for (int pass = 0; pass < 5; pass++) {
+    tokenizer tok = {buf, len, 0};
+    long long sum = 0;
+    int values[4096], got;
+    double t0 = now_seconds();
+    while ((got = tokenizer_read_ints(&tok, values, 4096)) > 0) {
+      for (int i = 0; i < got; i++) { sum += values[i]; }
+    }
+    double sec = now_seconds() - t0;
+    if (tok.pos != len || sum != expected) {
+      printf("tokenizer error at byte %zu\n", tok.pos);
+      free(buf);
+      return EXIT_FAILURE;
+    }
+    if (sec < best) { best = sec; }
+  }
+  printf("%-10s %8.1f MB %10.3f GB/s\n", "tokenizer", len / 1048576.0,
+         len / best / 1e9);
+
+  size_t scan_len = len < 16 * 1048576 ? len : 16 * 1048576;
+  FILE *fp = fmemopen(buf, scan_len, "r");
+  if (fp != NULL) {
+    long long sum = 0;
+    int value;
+    double t0 = now_seconds();
+    while (fscanf(fp, "%d", &value) == 1) { sum += value; }
+    double sec = now_seconds() - t0;
+    fclose(fp);
+    bench_sink = (int)sum;
+    printf("%-10s %8.1f MB %10.3f GB/s\n", "fscanf", scan_len / 1048576.0,
+           scan_len / sec / 1e9);
+  }
+  free(buf);
+  return EXIT_SUCCESS;
+}
+
+// --- Startup Benchmark ---
+
+/**
+ * @brief Runs this binary on a puzzle file and times it from fork to exit.
+ * @param args Arguments for the child, NULL-terminated; output goes to
+ * /dev/null.
+ * @return Elapsed seconds, or a negative value if the child failed.
+ */
+double time_child_run(char **args) {
+  double t0 = now_seconds();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) { dup2(null_fd, 1); }
+    execv("/proc/self/exe", args);
+    _exit(127);
+  }
+  int wstatus;
+  if (pid < 0 || waitpid(pid, &wstatus, 0) != pid || !WIFEXITED(wstatus) ||
+      WEXITSTATUS(wstatus) != 0) {
+    return -1;
+  }
+  return now_seconds() - t0;
+}
+
+/**
+ * @brief Compares the exec-to-exit time of the cold-start path with that of
+ * the general path of main.
+ * @details Writes a generated puzzle (half of its cells blank) to a
+ * temporary file and runs "./sudoku FILE" (cold start) and "./sudoku
+ * --engine fill FILE" (the general path, same work) alternately.
+ * @param argc Number of arguments after the mode.
+ * @param argv Optional run count (default 200) and board size (default 9),
+ * plus --save/--compare.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments, a failed child or
+ * a regression.
+ */
+int runStartupBenchmark(int argc, char **argv) {
+  bench_recorder rec;
+  recorder_init(&rec, &argc, argv);
+  int runs = argc > 0 ? atoi(argv[0]) : 200;
+  int psize = argc > 1 ? atoi(argv[1]) : 9;
+  int n = sqrt(psize);
+  if (runs < 2 || psize < 1 || n * n != psize) {
+    printf("usage: ./sudoku --bench-startup [runs] [size] "
+           "[--save|--add FILE] [--compare FILE]\n");
+    return EXIT_FAILURE;
+  }
+  char path[] = "/tmp/sudoku-startup-XXXXXX";
+  int fd = mkstemp(path);
+  FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+  if (fp == NULL) {
+    printf("Could not create a temporary puzzle file\n");
+    return EXIT_FAILURE;
+  }
+  int **board = makeSolvedPuzzle(psize);
+  blankPuzzleCells(psize, board, 0.5, 1);
+  fprintf(fp, "%d\n", psize);
+  for (int r = 1; r <= psize; r++) {
+    for (int c = 1; c <= psize; c++) {
+      fprintf(fp, c < psize ? "%d " : "%d\n", board[r][c]);
+    }
+  }
+  fclose(fp);
+  deleteSudokuPuzzle(psize, board);
+
+  char exe[] = "sudoku", engine_opt[] = "--engine", fill[] = "fill";
+  char *cold_args[] = {exe, path, NULL};
+  char *general_args[] = {exe, engine_opt, fill, path, NULL};
+  double *samples[2];
+  samples[0] = (double *)malloc(runs * sizeof(double));
+  samples[1] = (double *)malloc(runs * sizeof(double));
+  int status = EXIT_SUCCESS;
+  for (int i = 0; i < runs && status == EXIT_SUCCESS; i++) {
+    samples[0][i] = time_child_run(cold_args) * 1e6;
+    samples[1][i] = time_child_run(general_args) * 1e6;
+    if (samples[0][i] < 0 || samples[1][i] < 0) {
+      printf("A child run failed\n");
+      status = EXIT_FAILURE;
+    }
+  }
+  if (status == EXIT_SUCCESS) {
+    const char *names[2] = {"startup_cold", "startup_general"};
+    printf("%-18s %6s %10s %10s", "path", "size", "mean_us", "ci95_us");
+    recorder_header(&rec);
+    for (int k = 0; k < 2; k++) {
+      char name[64];
+      snprintf(name, sizeof(name), "%s_%d", names[k], psize);
+      bench_stats st = compute_stats(samples[k], runs);
+      printf("%-18s %6d %10.1f %10.1f", names[k], psize, st.mean, ci95(st));
+      recorder_report(&rec, name, st);
+      printf("\n");
+    }
+    status = recorder_finish(&rec);
+  }
+  unlink(path);
+  free(samples[0]);
+  free(samples[1]);
+  return status;
+}
+
+// Solvers selectable with --engine; fill is checkPuzzle's own loop
+// auto picks one of the others per puzzle (see Engine Selector)
+enum { ENGINE_FILL, ENGINE_SEARCH, ENGINE_TEMPLATE, ENGINE_AUTO };
+const char *engine_names[] = {"fill", "search", "template", "auto"};
+#define NUM_ENGINES 4
+
+/**
+ * @brief Prints the command-line usage.
+ */
+void printUsage(void) {
+  printf("usage: ./sudoku [--engine fill|search|template|auto] [--stats] "
+         "[--mem-budget SIZE] [--capture-slow MS] [--capture-dir DIR] "
+         "[--profile FILE] [--model FILE] puzzle.txt\n");
+  printf("       ./sudoku --bench-scaling [max_threads] [max_size] "
+         "[--save|--add FILE] [--compare FILE]\n");
+  printf("       ./sudoku --microbench [max_size] [--save|--add FILE] "
+         "[--compare FILE]\n");
+  printf("       ./sudoku --bench-hugepages [size ...]\n");
+  printf("       ./sudoku --bench-tokenizer [MB]\n");
+  printf("       ./sudoku --bench-startup [runs] [size] "
+         "[--save|--add FILE] [--compare FILE]\n");
+  printf("       ./sudoku --bench-replay DIR [reps]\n");
+  printf("       ./sudoku --autotune [max_size] [max_threads] "
+         "[--profile FILE]\n");
+  printf("       ./sudoku --bench-engines corpus.txt [--log FILE] "
+         "[--model FILE]\n");
+  printf("       ./sudoku --train-selector log.txt [--model FILE]\n");
+  printf("       ./sudoku --audit logs.txt|- [threads]\n");
+  printf("       ./sudoku --corpus-index corpus.txt [threads]\n");
+  printf("       ./sudoku --corpus-get corpus.txt id ...\n");
+  printf("       ./sudoku --corpus-sample corpus.txt count [--size RANGE] "
+         "[--clues RANGE] [--difficulty RANGE] [--seed N]\n");
+  printf("       ./sudoku --sample-solutions puzzle.txt count [--threads N] "
+         "[--seed N]\n");
+  printf("       ./sudoku --augment base.txt count out.bin [--threads N] "
+         "[--seed N]\n");
+  printf("       ./sudoku --boards-print file.bin [first] [count]\n");
+  printf("       ./sudoku --export-tensors puzzles.txt out.tensors [--bits] "
+         "[--threads N]\n");
+  printf("       ./sudoku --repair puzzle.txt [--threads N] [--time-limit MS]"
+         "\n");
+  printf("       ./sudoku --dedup corpus.txt [threads]\n");
+  printf("       ./sudoku --async [--workers N] [--engine E] [--model FILE]"
+         " puzzle.txt ...\n");
+  printf("       ./sudoku --serve [--workers N] [--engine E] [--model FILE]"
+         " [--bulk-workers N]\n"
+         "                [--bulk-queue N] [--bulk-weight N] [--fifo] [--delay]"
+         " [--metrics] < requests\n");
+  printf("       ./sudoku --trace puzzle.txt out.trace\n");
+  printf("       ./sudoku --replay file.trace [step]\n");
+}
+
+// --- Slow-Puzzle Capture ---
+
+/*
+ * With "--capture-slow MS", a run of main that takes MS milliseconds or
+ * more is saved to a ring of CAPTURE_RING_SLOTS files in the capture
+ * directory. The slots are slot-00.txt, slot-01.txt and so on; a counter
+ * file named "next", locked while it is updated, picks the slot. A slot
+ * holds the puzzle file as it was read, so it is itself a puzzle file.
+ * After the cells come the engine, the phase timings of last_run, the
+ * fill-in pass count and the engine statistics, which readers of puzzle
+ * files ignore. A fast run pays only for the timestamps of its phases. A
+ * slow run re-reads the puzzle file instead of keeping a copy of the grid.
+ * "--bench-replay DIR" runs every captured puzzle again.
+ */
+
+#define CAPTURE_RING_SLOTS 32
+
+const char *run_phase_names[NUM_RUN_PHASES] = {"read", "solve", "fill",
+                                               "validate", "print"};
+
+/**
+ * @brief Runs the engine chosen with --engine ahead of checkPuzzle.
+ * @details The fill engine is checkPuzzle's own loop, so it does nothing.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE after printing why the engine did
+ * not run to the end.
+ */
+int runEngine(int engine, int psize, int **grid, search_stats *stats,
+              template_stats *tstats) {
+  if (engine == ENGINE_SEARCH) {
+    // The search fills the grid; checkPuzzle then validates it as usual
+    search_options opts = search_default_options(psize);
+    if (solvePuzzleSearch(psize, grid, &opts, stats) == SEARCH_OUT_OF_MEMORY) {
+      printf("Search stopped: memory budget of %zu bytes exceeded\n",
+             mem_budget);
+      return EXIT_FAILURE;
+    }
+  } else if (engine == ENGINE_TEMPLATE) {
+    if (psize != 9) {
+      printf("The template engine only solves 9x9 puzzles\n");
+      return EXIT_FAILURE;
+    }
+    template_options topts = template_default_options();
+    if (solvePuzzleTemplate(grid, &topts, tstats) == SEARCH_OUT_OF_MEMORY) {
+      printf("Template engine stopped: not enough memory\n");
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Takes the next slot of a capture ring.
+ * @return The slot number, or -1 if the directory cannot be used.
+ */
+int capture_next_slot(const char *dir) {
+  mkdir(dir, 0777);
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/next", dir);
+  int fd = open(path, O_RDWR | O_CREAT, 0666);
+  if (fd < 0) { return -1; }
+  struct flock lock = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+  fcntl(fd, F_SETLKW, &lock);
+  char text[32] = "";
+  ssize_t got = pread(fd, text, sizeof(text) - 1, 0);
+  long next = got > 0 ? atol(text) : 0;
+  int n = snprintf(text, sizeof(text), "%ld\n", next + 1);
+  if (ftruncate(fd, 0) != 0 || pwrite(fd, text, n, 0) != n) { next = -1; }
+  lock.l_type = F_UNLCK;
+  fcntl(fd, F_SETLK, &lock);
+  close(fd);
+  return next < 0 ? -1 : (int)(next % CAPTURE_RING_SLOTS);
+}
+
+/**
+ * @brief Saves a slow run to the capture ring.
+ * @param puzzle_file The puzzle file of the run.
+ * @param total Seconds the run took up to the capture.
+ * @param stats, tstats Engine statistics; only those of engine are saved.
+ * @return false if the capture could not be written.
+ */
+bool captureSlowPuzzle(const char *dir, const char *puzzle_file, int engine,
+                       double total, const search_stats *stats,
+                       const template_stats *tstats) {
+  size_t len;
+  char *text = readWholeFile(puzzle_file, &len);
+  int slot = text != NULL ? capture_next_slot(dir) : -1;
+  if (slot < 0) {
+    free(text);
+    return false;
+  }
+  // Written under a temporary name and renamed, so a slot is never partial
+  char tmp[4096], path[4096];
+  snprintf(path, sizeof(path), "%s/slot-%02d.txt", dir, slot);
+  snprintf(tmp, sizeof(tmp), "%s/.slot-%02d.%ld", dir, slot, (long)getpid());
+  FILE *fp = fopen(tmp, "w");
+  if (fp == NULL) {
+    free(text);
+    return false;
+  }
+  fwrite(text, 1, len, fp);
+  free(text);
+  fprintf(fp, "\nsource %s\nengine %s\ntotal_ms %.3f\n", puzzle_file,
+          engine_names[engine], total * 1e3);
+  for (int ph = 0; ph < NUM_RUN_PHASES; ph++) {
+    fprintf(fp, "phase_ms %s %.3f\n", run_phase_names[ph],
+            last_run.seconds[ph] * 1e3);
+  }
+  fprintf(fp, "fill_passes %d\n", last_run.fill_passes);
+  if (engine == ENGINE_SEARCH) {
+    fprintf(fp,
+            "search nodes %ld backtracks %ld propagations %ld tasks %d mode "
+            "%s degradations %d tt_probes %ld tt_hits %ld tt_stores %ld\n",
+            stats->nodes, stats->backtracks, stats->propagations,
+            stats->threads, search_mode_names[stats->mode],
+            stats->degradations, stats->tt_probes, stats->tt_hits,
+            stats->tt_stores);
+  } else if (engine == ENGINE_TEMPLATE) {
+    fprintf(fp,
+            "template filtered %ld pruned %ld prune_rounds %d nodes %ld "
+            "threads %d\n",
+            tstats->filtered, tstats->pruned, tstats->prune_rounds,
+            tstats->nodes, tstats->threads);
+  }
+  bool ok = fclose(fp) == 0 && rename(tmp, path) == 0;
+  if (!ok) { unlink(tmp); }
+  return ok;
+}
+
+/**
+ * @brief Orders file names for --bench-replay.
+ */
+int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Replays the puzzles of a capture ring.
+ * @details Runs each slot's puzzle with its recorded engine, then
+ * checkPuzzle, reps times on a fresh copy. Prints the captured solve, fill
+ * and validate phases, which timed the same work, beside the mean replay
+ * time and its 95% confidence interval. Reading and printing are not
+ * replayed, so the captured total is not comparable.
+ * @param argc Number of arguments after the mode.
+ * @param argv The capture directory and an optional repetition count
+ * (default 5).
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the directory cannot be read.
+ */
+int runReplayBenchmark(int argc, char **argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 5;
+  if (argc < 1 || argc > 2 || reps < 1) {
+    printf("usage: ./sudoku --bench-replay DIR [reps]\n");
+    return EXIT_FAILURE;
+  }
+  DIR *d = opendir(argv[0]);
+  if (d == NULL) {
+    printf("Could not open directory %s\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char **names = NULL;
+  int num_names = 0;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (strncmp(e->d_name, "slot-", 5) == 0) {
+      names = (char **)realloc(names, (num_names + 1) * sizeof(char *));
+      names[num_names++] = strdup(e->d_name);
+    }
+  }
+  closedir(d);
+  qsort(names, num_names, sizeof(char *), compare_names);
+
+  printf("%-12s %6s %-8s %12s %12s %10s\n", "slot", "size", "engine",
+         "captured_ms", "replay_ms", "ci95_ms");
+  double samples[reps];
+  for (int i = 0; i < num_names; i++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", argv[0], names[i]);
+    size_t len;
+    char *text = readWholeFile(path, &len);
+    const char *field = text != NULL ? strstr(text, "\nengine ") : NULL;
+    int engine = 0;
+    while (field != NULL && engine < NUM_ENGINES &&
+           strncmp(field + 8, engine_names[engine],
+                   strlen(engine_names[engine])) != 0) {
+      engine++;
+    }
+    // The replay times what these phases timed: the engine and checkPuzzle
+    double captured = 0;
+    for (int ph = RUN_SOLVE; ph <= RUN_VALIDATE; ph++) {
+      char key[32];
+      int n = snprintf(key, sizeof(key), "\nphase_ms %s ", run_phase_names[ph]);
+      field = text != NULL ? strstr(text, key) : NULL;
+      if (field != NULL) { captured += atof(field + n); }
+    }
+    free(text);
+    if (engine == NUM_ENGINES) { engine = ENGINE_FILL; }
+
+    int **puzzle = NULL;
+    int psize = readSudokuPuzzle(path, &puzzle);
+    int **work = allocSudokuPuzzle(psize);
+    for (int r = 0; r < reps; r++) {
+      copySudokuPuzzle(psize, work, puzzle);
+      search_stats stats;
+      template_stats tstats;
+      bool complete, valid;
+      double t0 = now_seconds();
+      if (runEngine(engine, psize, work, &stats, &tstats) == EXIT_SUCCESS) {
+        checkPuzzle(psize, work, &complete, &valid);
+      }
+      samples[r] = (now_seconds() - t0) * 1e3;
+    }
+    bench_stats st = compute_stats(samples, reps);
+    printf("%-12s %6d %-8s %12.3f %12.3f %10.3f\n", names[i], psize,
+           engine_names[engine], captured, st.mean, ci95(st));
+    deleteSudokuPuzzle(psize, work);
+    deleteSudokuPuzzle(psize, puzzle);
+    free(names[i]);
+  }
+  free(names);
+  return EXIT_SUCCESS;
+}
+
+// --- Engine Selector ---
+
+/*
+ * "--engine auto" predicts the fastest engine for a puzzle instead of
+ * racing them. Features are computed right after parsing:
+ * - the size and the fraction of cells given;
+ * - the fewest, most and spread of clues over rows, columns and subgrids;
+ * - the fraction of units with a single empty cell, which is what the
+ *   fill-in loop needs;
+ * - candidate statistics of the empty cells before and after one pass of
+ *   naked singles.
+ * A small decision tree, read from selector-model.txt (or --model FILE),
+ * maps the features to an engine. Without a model, auto runs the search.
+ * If fill is predicted and leaves the board incomplete, the search finishes
+ * it, so a wrong prediction costs time, never the answer.
+ *
+ * The tree is trained offline. "--bench-engines CORPUS --log FILE" times
+ * every engine on every puzzle of a corpus and logs the features and
+ * times. "--train-selector LOG" grows the tree that minimizes the total
+ * routed time of the logged puzzles. Routing to fill counts the search
+ * fallback when fill does not finish, and template is only allowed at 9x9.
+ * Each split is the feature threshold that lowers that total the most.
+ * "--bench-engines" with a model reports its accuracy (how often it picks
+ * the fastest engine) and the speedup of the routed total over always
+ * running one engine.
+ */
+
+#define SELECT_MODEL_DEFAULT "selector-model.txt"
+#define SELECT_MAX_DEPTH 4
+#define SELECT_MIN_LEAF 8
+// Cap on search nodes while benchmarking, so one puzzle cannot stall a run
+#define SELECT_MAX_NODES 100000
+#define SELECT_REPS 3
+
+enum {
+  FEAT_PSIZE,
+  FEAT_CLUE_FRAC,
+  FEAT_UNIT_CLUE_MIN,
+  FEAT_UNIT_CLUE_MAX,
+  FEAT_UNIT_CLUE_SD,
+  FEAT_ONE_ZERO_UNITS,
+  FEAT_SINGLE_FRAC,
+  FEAT_EMPTY_AFTER,
+  FEAT_CAND_MEAN,
+  FEAT_CAND_MIN,
+  NUM_FEATURES
+};
+const char *feature_names[NUM_FEATURES] = {
+    "psize",          "clue_frac",      "unit_clue_min", "unit_clue_max",
+    "unit_clue_sd",   "one_zero_units", "single_frac",   "empty_after",
+    "cand_mean",      "cand_min"};
+
+// Engines the selector routes to (engine_names order)
+#define NUM_SELECT_ENGINES 3
+
+// A tree node; feature < 0 marks a leaf
+typedef struct {
+  int feature;
+  double threshold;  // Go left if the feature is <= threshold
+  int left, right;
+  int engine;        // Leaves: ENGINE_*
+} select_node;
+
+select_node *select_tree = NULL;
+int num_select_nodes = 0;
+
+/**
+ * @brief Computes the selector features of a puzzle.
+ * @param f Output: NUM_FEATURES values.
+ * @return false if out of memory or over the memory budget.
+ */
+bool extract_features(int psize, int **grid, double *f) {
+  int box = sqrt(psize);
+  int units = 3 * psize;
+  int counts[units];
+  memset(counts, 0, sizeof(counts));
+  long clues = 0;
+  for (int r = 0; r < psize; r++) {
+    for (int c = 0; c < psize; c++) {
+      if (grid[r + 1][c + 1] == 0) { continue; }
+      clues++;
+      counts[r]++;
+      counts[psize + c]++;
+      counts[2 * psize + (r / box) * box + c / box]++;
+    }
+  }
+  double sum = 0, sq = 0;
+  int lo = psize, hi = 0, one_zero = 0;
+  for (int u = 0; u < units; u++) {
+    lo = counts[u] < lo ? counts[u] : lo;
+    hi = counts[u] > hi ? counts[u] : hi;
+    one_zero += counts[u] == psize - 1;
+    sum += counts[u];
+    sq += (double)counts[u] * counts[u];
+  }
+  double mean = sum / units;
+  f[FEAT_PSIZE] = psize;
+  f[FEAT_CLUE_FRAC] = (double)clues / ((double)psize * psize);
+  f[FEAT_UNIT_CLUE_MIN] = (double)lo / psize;
+  f[FEAT_UNIT_CLUE_MAX] = (double)hi / psize;
+  f[FEAT_UNIT_CLUE_SD] = sqrt(fmax(sq / units - mean * mean, 0)) / psize;
+  f[FEAT_ONE_ZERO_UNITS] = (double)one_zero / units;
+
+  // Candidates before and after one pass of naked singles
+  void *mem = hugeAlloc(search_state_bytes(psize), false);
+  if (mem == NULL) { return false; }
+  search_state s;
+  search_state_bind(&s, psize, mem);
+  uint64_t cand[s.words];
+  int ncells = psize * psize, empty_before = 0, singles = 0;
+  if (!search_state_load(&s, grid)) {
+    // Conflicting clues: every engine finds that out quickly
+    f[FEAT_SINGLE_FRAC] = f[FEAT_EMPTY_AFTER] = 0;
+    f[FEAT_CAND_MEAN] = f[FEAT_CAND_MIN] = 0;
+    hugeFree(mem);
+    return true;
+  }
+  for (int cell = 0; cell < ncells; cell++) {
+    if (s.cells[cell] != 0) { continue; }
+    empty_before++;
+    if (search_candidates(&s, cell, cand) == 1) {
+      singles++;
+      int w = 0;
+      while (cand[w] == 0) { w++; }
+      search_assign(&s, cell, 64 * w + __builtin_ctzll(cand[w]) + 1);
+    }
+  }
+  long cand_sum = 0;
+  int cand_min = s.empty > 0 ? psize : 0;
+  for (int cell = 0; cell < ncells; cell++) {
+    if (s.cells[cell] != 0) { continue; }
+    int n = search_candidates(&s, cell, cand);
+    cand_sum += n;
+    cand_min = n < cand_min ? n : cand_min;
+  }
+  f[FEAT_SINGLE_FRAC] = empty_before > 0 ? (double)singles / empty_before : 0;
+  f[FEAT_EMPTY_AFTER] = (double)s.empty / ncells;
+  f[FEAT_CAND_MEAN] = s.empty > 0 ? (double)cand_sum / s.empty / psize : 0;
+  f[FEAT_CAND_MIN] = cand_min;
+  hugeFree(mem);
+  return true;
+}
+
+/**
+ * @brief Loads a selector model; a missing file leaves none loaded.
+ * @details One node per line in preorder: "split FEATURE THRESHOLD" (its
+ * left then right subtree follow) or "leaf ENGINE".
+ * @return false if the file exists but is not a model.
+ */
+bool loadSelectorModel(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) { return true; }
+  char line[256], kind[16], name[64];
+  int pending[64]; // Nodes still waiting for their right child
+  int num_pending = 0;
+  bool ok = true, done = false;
+  while (ok && fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') { continue; }
+    select_node n = {-1, 0, -1, -1, ENGINE_SEARCH};
+    double threshold = 0;
+    int got = sscanf(line, "%15s %63s %lf", kind, name, &threshold);
+    if (got == 3 && strcmp(kind, "split") == 0) {
+      for (n.feature = 0; n.feature < NUM_FEATURES &&
+                          strcmp(name, feature_names[n.feature]) != 0;
+           n.feature++) {
+      }
+      n.threshold = threshold;
+      ok = n.feature < NUM_FEATURES && num_pending < 64;
+    } else if (got == 2 && strcmp(kind, "leaf") == 0) {
+      for (n.engine = 0; n.engine < NUM_SELECT_ENGINES &&
+                         strcmp(name, engine_names[n.engine]) != 0;
+           n.engine++) {
+      }
+      ok = n.engine < NUM_SELECT_ENGINES;
+    } else {
+      ok = false;
+    }
+    ok = ok && !done;
+    if (!ok) { break; }
+    int id = num_select_nodes++;
+    select_tree = (select_node *)realloc(select_tree,
+                                         num_select_nodes * sizeof(select_node));
+    select_tree[id] = n;
+    // Link to the parent: a split's next node is its left child
+    if (id > 0 && select_tree[id - 1].feature >= 0 &&
+        select_tree[id - 1].left < 0) {
+      select_tree[id - 1].left = id;
+    } else if (id > 0) {
+      select_tree[pending[--num_pending]].right = id;
+    }
+    if (n.feature >= 0) {
+      pending[num_pending++] = id;
+    } else {
+      done = num_pending == 0;
+    }
+  }
+  fclose(fp);
+  if (!ok || !done) {
+    free(select_tree);
+    select_tree = NULL;
+    num_select_nodes = 0;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Picks the engine for a puzzle with the loaded model.
+ * @return ENGINE_SEARCH if no model is loaded, psize is not a square or
+ * there is no memory for the features; never template off 9x9.
+ */
+int selectEngine(int psize, int **grid) {
+  int box = sqrt(psize);
+  if (num_select_nodes == 0 || box * box != psize) { return ENGINE_SEARCH; }
+  double f[NUM_FEATURES];
+  if (!extract_features(psize, grid, f)) { return ENGINE_SEARCH; }
+  int n = 0;
+  while (select_tree[n].feature >= 0) {
+    n = f[select_tree[n].feature] <= select_tree[n].threshold
+            ? select_tree[n].left
+            : select_tree[n].right;
+  }
+  int engine = select_tree[n].engine;
+  return engine == ENGINE_TEMPLATE && psize != 9 ? ENGINE_SEARCH : engine;
+}
+
+// One logged puzzle: features and the time of each engine
+typedef struct {
+  double f[NUM_FEATURES];
+  double seconds[NUM_SELECT_ENGINES];  // < 0 if the engine was not run
+  bool solved[NUM_SELECT_ENGINES];     // Left a complete, valid board
+} select_sample;
+
+/**
+ * @brief Seconds it costs to route a sample to an engine.
+ * @details Fill that does not finish is followed by the search; template
+ * is not an option off 9x9. A route that leaves unsolved a puzzle some
+ * engine solved (a search stopped at SELECT_MAX_NODES) costs INFINITY: its
+ * time only bounds what finishing would have taken. A puzzle no engine
+ * solves costs each route its time.
+ */
+double route_cost(const select_sample *s, int engine) {
+  if (s->seconds[engine] < 0) { return INFINITY; }
+  double seconds = s->seconds[engine];
+  bool solved = s->solved[engine], solvable = false;
+  if (engine == ENGINE_FILL && !solved) {
+    seconds += s->seconds[ENGINE_SEARCH];
+    solved = s->solved[ENGINE_SEARCH];
+  }
+  for (int e = 0; e < NUM_SELECT_ENGINES; e++) { solvable |= s->solved[e]; }
+  return solvable && !solved ? INFINITY : seconds;
+}
+
+/**
+ * @brief The engine with the lowest route_cost for a sample.
+ */
+int best_engine(const select_sample *s) {
+  int best = 0;
+  for (int e = 1; e < NUM_SELECT_ENGINES; e++) {
+    if (route_cost(s, e) < route_cost(s, best)) { best = e; }
+  }
+  return best;
+}
+
+/**
+ * @brief Times each engine on a puzzle, best of SELECT_REPS runs, including
+ * checkPuzzle as main runs it.
+ */
+void time_engines(int psize, int **puzzle, int **work, select_sample *out) {
+  for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+    out->seconds[e] = -1;
+    out->solved[e] = false;
+    if (e == ENGINE_TEMPLATE && psize != 9) { continue; }
+    for (int rep = 0; rep < SELECT_REPS; rep++) {
+      copySudokuPuzzle(psize, work, puzzle);
+      bool complete, valid;
+      double t0 = now_seconds();
+      if (e == ENGINE_SEARCH) {
+        search_options opts = search_default_options(psize);
+        opts.max_nodes = SELECT_MAX_NODES;
+        solvePuzzleSearch(psize, work, &opts, NULL);
+      } else if (e == ENGINE_TEMPLATE) {
+        template_options topts = template_default_options();
+        template_stats tstats;
+        solvePuzzleTemplate(work, &topts, &tstats);
+      }
+      checkPuzzle(psize, work, &complete, &valid);
+      double sec = now_seconds() - t0;
+      if (rep == 0 || sec < out->seconds[e]) { out->seconds[e] = sec; }
+      out->solved[e] = complete && valid;
+    }
+  }
+}
+
+// Argument of sample_feature_cmp
+typedef struct {
+  const select_sample *samples;
+  int feature;
+} feature_order;
+
+/**
+ * @brief Orders sample indexes by one feature (qsort_r).
+ * @param arg A feature_order.
+ */
+int sample_feature_cmp(const void *a, const void *b, void *arg) {
+  const feature_order *o = (const feature_order *)arg;
+  double x = o->samples[*(const int *)a].f[o->feature];
+  double y = o->samples[*(const int *)b].f[o->feature];
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Lowest total route cost of a set of samples and its engine.
+ */
+double leaf_cost(const double *totals, int *engine) {
+  *engine = 0;
+  for (int e = 1; e < NUM_SELECT_ENGINES; e++) {
+    if (totals[e] < totals[*engine]) { *engine = e; }
+  }
+  return totals[*engine];
+}
+
+/**
+ * @brief Grows the subtree for samples idx[0..n) (see the section comment).
+ * @return The id of the subtree's root in select_tree.
+ */
+int grow_tree(const select_sample *s, int *idx, int n, int depth) {
+  double totals[NUM_SELECT_ENGINES] = {0};
+  for (int i = 0; i < n; i++) {
+    for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+      totals[e] += route_cost(&s[idx[i]], e);
+    }
+  }
+  int id = num_select_nodes++;
+  select_tree = (select_node *)realloc(select_tree,
+                                       num_select_nodes * sizeof(select_node));
+  select_node node = {-1, 0, -1, -1, 0};
+  double best = leaf_cost(totals, &node.engine);
+  int best_feature = -1, best_k = 0;
+  for (int feature = 0; depth < SELECT_MAX_DEPTH &&
+                        n >= 2 * SELECT_MIN_LEAF && feature < NUM_FEATURES;
+       feature++) {
+    feature_order order = {s, feature};
+    qsort_r(idx, n, sizeof(int), sample_feature_cmp, &order);
+    double left[NUM_SELECT_ENGINES] = {0}, right[NUM_SELECT_ENGINES];
+    for (int k = 1; k < n; k++) {
+      for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+        left[e] += route_cost(&s[idx[k - 1]], e);
+        right[e] = totals[e] - left[e];
+      }
+      if (k < SELECT_MIN_LEAF || n - k < SELECT_MIN_LEAF ||
+          s[idx[k - 1]].f[feature] == s[idx[k]].f[feature]) {
+        continue;
+      }
+      int le, re;
+      double cost = leaf_cost(left, &le) + leaf_cost(right, &re);
+      if (cost < best * (1 - 1e-9)) {
+        best = cost;
+        best_feature = feature;
+        best_k = k;
+      }
+    }
+  }
+  if (best_feature >= 0) {
+    int feature = best_feature;
+    feature_order order = {s, feature};
+    qsort_r(idx, n, sizeof(int), sample_feature_cmp, &order);
+    node.feature = feature;
+    node.threshold = (s[idx[best_k - 1]].f[feature] + s[idx[best_k]].f[feature]) / 2;
+    node.left = grow_tree(s, idx, best_k, depth + 1);
+    node.right = grow_tree(s, idx + best_k, n - best_k, depth + 1);
+  }
+  select_tree[id] = node;
+  return id;
+}
+
+/**
+ * @brief Writes a subtree in the model format, in preorder.
+ */
+void write_tree(FILE *fp, int id, int depth) {
+  const select_node *n = &select_tree[id];
+  if (n->feature < 0) {
+    fprintf(fp, "%*sleaf %s\n", 2 * depth, "", engine_names[n->engine]);
+    return;
+  }
+  fprintf(fp, "%*ssplit %s %.17g\n", 2 * depth, "", feature_names[n->feature],
+          n->threshold);
+  write_tree(fp, n->left, depth + 1);
+  write_tree(fp, n->right, depth + 1);
+}
+
+/**
+ * @brief Reads a benchmark log written by --bench-engines --log.
+ * @return The samples (to free), or NULL if the file cannot be read.
+ */
+select_sample *read_select_log(const char *path, int *count) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) { return NULL; }
+  select_sample *samples = NULL;
+  int n = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#') { continue; }
+    select_sample s;
+    char *p = line, *end;
+    int fields = 0;
+    for (int i = 0; i < NUM_FEATURES; i++, p = end) {
+      s.f[i] = strtod(p, &end);
+      fields += end != p;
+    }
+    for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+      s.seconds[e] = strtod(p, &end);
+      fields += end != p;
+      p = end;
+      s.solved[e] = strtol(p, &end, 10) != 0;
+      fields += end != p;
+      p = end;
+    }
+    if (fields != NUM_FEATURES + 2 * NUM_SELECT_ENGINES) { continue; }
+    samples = (select_sample *)realloc(samples, (n + 1) * sizeof(*samples));
+    samples[n++] = s;
+  }
+  fclose(fp);
+  *count = n;
+  return samples;
+}
+
+/**
+ * @brief Prints the accuracy of the loaded model on samples and the routed
+ * total against each single engine and the best possible routing.
+ */
+void report_selection(const select_sample *s, int n) {
+  double always[NUM_SELECT_ENGINES] = {0}, routed = 0, oracle = 0;
+  int correct = 0, unsolved = 0;
+  for (int i = 0; i < n; i++) {
+    int node = 0;
+    while (select_tree[node].feature >= 0) {
+      node = s[i].f[select_tree[node].feature] <= select_tree[node].threshold
+                 ? select_tree[node].left
+                 : select_tree[node].right;
+    }
+    int pick = select_tree[node].engine;
+    if (pick == ENGINE_TEMPLATE && s[i].f[FEAT_PSIZE] != 9) {
+      pick = ENGINE_SEARCH;
+    }
+    int best = best_engine(&s[i]);
+    correct += pick == best;
+    unsolved += isinf(route_cost(&s[i], pick));
+    routed += route_cost(&s[i], pick);
+    oracle += route_cost(&s[i], best);
+    for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+      always[e] += route_cost(&s[i], e);
+    }
+  }
+  printf("accuracy %.1f%% (%d of %d picked the fastest engine)\n",
+         100.0 * correct / n, correct, n);
+  if (unsolved > 0) {
+    printf("%d routed to an engine that gave up; the selector total is "
+           "infinite\n",
+           unsolved);
+  }
+  printf("%-16s %12s %10s\n", "routing", "total_ms", "speedup");
+  for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+    if (isinf(always[e])) { continue; }
+    char name[32];
+    snprintf(name, sizeof(name), "always %s", engine_names[e]);
+    printf("%-16s %12.3f %10.2f\n", name, always[e] * 1e3, always[e] / routed);
+  }
+  printf("%-16s %12.3f %10.2f\n", "selector", routed * 1e3, 1.0);
+  printf("%-16s %12.3f %10.2f\n", "oracle", oracle * 1e3, oracle / routed);
+}
+
+/**
+ * @brief Times every engine on every puzzle of a corpus.
+ * @param argv The corpus, then optional "--log FILE" (write the samples
+ * for --train-selector) and "--model FILE" (report that model; default
+ * selector-model.txt if it exists).
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or input.
+ */
+int runEngineBenchmark(int argc, char **argv) {
+  const char *log_path = NULL, *model = SELECT_MODEL_DEFAULT;
+  bool ok = argc >= 1;
+  for (int i = 1; ok && i < argc; i += 2) {
+    if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      log_path = argv[i + 1];
+    } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+      model = argv[i + 1];
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    printf("usage: ./sudoku --bench-engines corpus.txt [--log FILE] "
+           "[--model FILE]\n");
+    return EXIT_FAILURE;
+  }
+  if (!loadSelectorModel(model)) {
+    printf("Could not read selector model %s\n", model);
+    return EXIT_FAILURE;
+  }
+  size_t len;
+  char *text = readWholeFile(argv[0], &len);
+  if (text == NULL) {
+    printf("Could not open file %s\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  FILE *log = log_path != NULL ? fopen(log_path, "w") : NULL;
+  if (log_path != NULL && log == NULL) {
+    printf("Could not open file %s\n", log_path);
+    free(text);
+    return EXIT_FAILURE;
+  }
+  if (log != NULL) {
+    fprintf(log, "#");
+    for (int i = 0; i < NUM_FEATURES; i++) {
+      fprintf(log, " %s", feature_names[i]);
+    }
+    for (int e = 0; e < NUM_SELECT_ENGINES; e++) {
+      fprintf(log, " sec_%s ok_%s", engine_names[e], engine_names[e]);
+    }
+    fprintf(log, "\n");
+  }
+  select_sample *samples = NULL;
+  int n = 0;
+  bool out_of_memory = false;
+  tokenizer tok = {text, len, 0};
+  int psize, got;
+  while ((got = tokenizer_next(&tok, &psize)) == 1 && psize > 0) {
+    int **puzzle = allocSudokuPuzzle(psize);
+    int **work = allocSudokuPuzzle(psize);
+    int box = sqrt(psize);
+    bool read = puzzle != NULL && work != NULL && box * box == psize;
+    for (int row = 1; read && row <= psize; row++) {
+      read = tokenizer_read_ints(&tok, &puzzle[row][1], psize) == psize;
+    }
+    select_sample s;
+    out_of_memory = read && !extract_features(psize, puzzle, s.f);
+    if (read && !out_of_memory) {
+      time_engines(psize, puzzle, work, &s);
+      samples = (select_sample *)realloc(samples, (n + 1) * sizeof(s));
+      samples[n++] = s;
+      for (int i = 0; log != NULL && i < NUM_FEATURES; i++) {
+        fprintf(log, "%.9g ", s.f[i]);
+      }
+      for (int e = 0; log != NULL && e < NUM_SELECT_ENGINES; e++) {
+        fprintf(log, "%.9g %d%s", s.seconds[e], s.solved[e],
+                e + 1 < NUM_SELECT_ENGINES ? " " : "\n");
+      }
+    }
+    if (puzzle != NULL) { deleteSudokuPuzzle(psize, puzzle); }
+    if (work != NULL) { deleteSudokuPuzzle(psize, work); }
+    if (!read || out_of_memory) {
+      got = -1;
+      break;
+    }
+  }
+  free(text);
+  if (log != NULL) { fclose(log); }
+  int status = EXIT_SUCCESS;
+  if (out_of_memory) {
+    printf("Not enough memory to time puzzle %d of %s\n", n + 1, argv[0]);
+    status = EXIT_FAILURE;
+  } else if (got != 0) {
+    printf("Could not read puzzle %d of %s\n", n, argv[0]);
+    status = EXIT_FAILURE;
+  } else {
+    printf("Timed %d puzzle(s)\n", n);
+    if (num_select_nodes > 0 && n > 0) { report_selection(samples, n); }
+  }
+  free(samples);
+  return status;
+}
+
+/**
+ * @brief Trains a selector model from a benchmark log.
+ * @param argv The log, then optional "--model FILE" (default
+ * selector-model.txt).
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or files.
+ */
+int runTrainSelector(int argc, char **argv) {
+  const char *model = SELECT_MODEL_DEFAULT;
+  if (argc == 3 && strcmp(argv[1], "--model") == 0) {
+    model = argv[2];
+  } else if (argc != 1) {
+    printf("usage: ./sudoku --train-selector log.txt [--model FILE]\n");
+    return EXIT_FAILURE;
+  }
+  int n = 0;
+  select_sample *samples = read_select_log(argv[0], &n);
+  if (samples == NULL || n == 0) {
+    printf("Could not read samples from %s\n", argv[0]);
+    free(samples);
+    return EXIT_FAILURE;
+  }
+  int idx[n];
+  for (int i = 0; i < n; i++) { idx[i] = i; }
+  grow_tree(samples, idx, n, 0);
+  FILE *fp = fopen(model, "w");
+  if (fp == NULL) {
+    printf("Could not open file %s\n", model);
+    free(samples);
+    return EXIT_FAILURE;
+  }
+  fprintf(fp, "# sudoku engine selector trained on %d puzzle(s) of %s\n", n,
+          argv[0]);
+  write_tree(fp, 0, 0);
+  fclose(fp);
+  printf("Wrote %s (%d nodes); on the training puzzles:\n", model,
+         num_select_nodes);
+  report_selection(samples, n);
+  free(samples);
+  return EXIT_SUCCESS;
+}
+
+// --- Asynchronous API ---
+
+/*
+ * checkPuzzle blocks its caller while it creates and joins threads, which
+ * an event loop cannot afford. sudokuAsyncCreate starts a pool of workers;
+ * sudokuSubmit copies a puzzle into a job queue and returns a ticket at
+ * once; the workers solve and check jobs one per worker, single-threaded
+ * (checkPuzzleThreads with one thread, the engines with one task), so many
+ * puzzles are in flight on a fixed set of threads. Finished jobs are
+ * pushed on a lock-free completion stack and signal a notification
+ * descriptor, an eventfd on Linux and a pipe elsewhere, that the host adds
+ * to its poll/epoll set. sudokuPoll, called from one thread (the event
+ * loop), takes the whole stack with one atomic exchange and hands the
+ * results out in completion order, so it never waits for a lock: a worker
+ * preempted at the wrong moment cannot stall the event loop. The job queues
+ * have a mutex, held only to link or unlink a job, for the workers'
+ * condition variable.
+ *
+ * The descriptor is readable while results are waiting. A worker pushes
+ * before it signals; sudokuPoll, finding nothing, clears the descriptor and
+ * then looks at the stack once more, so a result pushed in between is
+ * either seen then or signals again afterwards. A wakeup is never lost; a
+ * stale one just makes sudokuPoll return false.
+ *
+ * Jobs come in priority classes, so a flood of bulk validation does not
+ * queue interactive requests behind it. Each class has its own queue and a
+ * policy: a weight, a limit on the workers running it at once and a bound
+ * on its queue depth. A free worker takes the next job by smooth weighted
+ * round-robin over the classes that have jobs and are under their limit;
+ * by default bulk may not use the last worker, so an interactive job never
+ * waits for a bulk solve to finish. Beyond its depth bound sudokuSubmit
+ * rejects a job (ASYNC_REJECTED) and the host decides whether to drop it or
+ * hold it and retry. Every class keeps counts and log-scale histograms of
+ * its queue wait and total latency (sudokuAsyncStats).
+ */
+
+enum { ASYNC_INTERACTIVE, ASYNC_BULK, NUM_ASYNC_CLASSES };
+const char *async_class_names[NUM_ASYNC_CLASSES] = {"interactive", "bulk"};
+
+#define ASYNC_REJECTED -2
+#define ASYNC_DEFAULT_QUEUE 1024
+#define ASYNC_LATENCY_BUCKETS 100  // Ten per decade, from 1 us to 10^4 s
+
+typedef struct async_job {
+  struct async_job *next;
+  long ticket;
+  int cls;               // ASYNC_INTERACTIVE or ASYNC_BULK
+  int engine;            // ENGINE_FILL, ENGINE_SEARCH, ENGINE_TEMPLATE or
+                         // ENGINE_AUTO; the engine used once solved
+  int psize;
+  int **grid;            // The puzzle, then the result
+  bool complete, valid;
+  double submitted;      // now_seconds at submission
+  double wait;           // Time queued
+  double seconds;        // Solve and check time
+} async_job;
+
+typedef struct {
+  async_job *head, *tail;
+} async_queue;
+
+typedef struct {
+  long ticket;
+  int cls;
+  int engine;   // Engine that produced the grid
+  int psize;
+  int **grid;   // Owned by the caller; free with deleteSudokuPuzzle
+  bool complete;
+  bool valid;
+  double wait;  // Time queued
+  double seconds;
+} sudoku_result;
+
+typedef struct {
+  int weight;       // Share of the picks while several classes wait
+  int max_running;  // Workers that may run jobs of the class at once
+  int max_queued;   // Queue depth beyond which sudokuSubmit rejects
+} async_policy;
+
+typedef struct {
+  long accepted, rejected, completed;
+  long wait[ASYNC_LATENCY_BUCKETS];   // Submission to start
+  long total[ASYNC_LATENCY_BUCKETS];  // Submission to completion
+} async_stats;
+
+typedef struct {
+  async_policy policy;
+  async_queue pending;
+  int queued, running;
+  int credit;         // Smooth weighted round-robin state
+  async_stats stats;
+} async_class;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;   // Signaled when a job may be started or on shutdown
+  async_class classes[NUM_ASYNC_CLASSES];
+  bool fifo;             // One queue for all classes (no priorities)
+  async_job *completed;  // Lock-free stack of finished jobs, newest first
+  async_queue ready;     // Finished jobs taken by sudokuPoll, oldest first
+  long next_ticket;
+  bool stopping;
+  int notify[2];         // Read and write ends (the same eventfd on Linux)
+  int num_workers;
+  pthread_t *workers;
+} sudoku_async;
+
+/**
+ * @brief Appends a job to a queue.
+ */
+void async_push(async_queue *q, async_job *job) {
+  job->next = NULL;
+  if (q->tail == NULL) {
+    q->head = job;
+  } else {
+    q->tail->next = job;
+  }
+  q->tail = job;
+}
+
+/**
+ * @brief Removes the first job of a queue.
+ * @return The job, or NULL if the queue is empty.
+ */
+async_job *async_pop(async_queue *q) {
+  async_job *job = q->head;
+  if (job != NULL) {
+    q->head = job->next;
+    if (q->head == NULL) { q->tail = NULL; }
+  }
+  return job;
+}
+
+/**
+ * @brief Makes the notification descriptor readable.
+ */
+void async_signal(sudoku_async *a) {
+#ifdef __linux__
+  uint64_t one = 1;
+  ssize_t n = write(a->notify[1], &one, sizeof(one));
+#else
+  char one = 1;
+  ssize_t n = write(a->notify[1], &one, 1); // A full pipe is readable anyway
+#endif
+  (void)n;
+}
+
+/**
+ * @brief Clears the notification descriptor without blocking.
+ */
+void async_drain(sudoku_async *a) {
+  uint64_t buf[8];
+  while (read(a->notify[0], buf, sizeof(buf)) > 0) {
+#ifdef __linux__
+    break; // One read resets an eventfd
+#endif
+  }
+}
+
+/**
+ * @brief Solves and checks one job on the calling thread.
+ */
+void async_solve(async_job *job) {
+  int psize = job->psize, **grid = job->grid;
+  bool routed = job->engine == ENGINE_AUTO;
+  if (routed) { job->engine = selectEngine(psize, grid); }
+  bool search = job->engine != ENGINE_FILL;
+  if (job->engine == ENGINE_TEMPLATE && psize == 9) {
+    template_options topts = template_default_options();
+    topts.threads = 1;
+    // Without its tables the template engine leaves the job to the search
+    search = solvePuzzleTemplate(grid, &topts, NULL) == SEARCH_OUT_OF_MEMORY;
+    if (search) { job->engine = ENGINE_SEARCH; }
+  }
+  if (search) {
+    search_options opts = search_default_options(psize);
+    opts.threads = 1;
+    solvePuzzleSearch(psize, grid, &opts, NULL);
+  }
+  checkPuzzleThreads(psize, grid, 1, &job->complete, &job->valid);
+  if (routed && job->engine == ENGINE_FILL && !job->complete) {
+    job->engine = ENGINE_SEARCH;
+    search_options opts = search_default_options(psize);
+    opts.threads = 1;
+    solvePuzzleSearch(psize, grid, &opts, NULL);
+    checkPuzzleThreads(psize, grid, 1, &job->complete, &job->valid);
+  }
+}
+
+/**
+ * @brief Returns the latency histogram bucket of a duration.
+ */
+int async_bucket(double seconds) {
+  double us = seconds * 1e6;
+  if (us < 1) { return 0; }
+  int b = (int)(10 * log10(us));
+  return b < ASYNC_LATENCY_BUCKETS ? b : ASYNC_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Returns a percentile of a latency histogram, as the upper edge of
+ * its bucket (within 26%).
+ * @param q The fraction, e.g. 0.99.
+ * @return Seconds, or 0 for an empty histogram.
+ */
+double async_percentile(const long *hist, double q) {
+  long total = 0;
+  for (int b = 0; b < ASYNC_LATENCY_BUCKETS; b++) { total += hist[b]; }
+  if (total == 0) { return 0; }
+  long target = (long)ceil(q * total), seen = 0;
+  int b = 0;
+  for (; b < ASYNC_LATENCY_BUCKETS - 1; b++) {
+    seen += hist[b];
+    if (seen >= target) { break; }
+  }
+  return 1e-6 * pow(10, (b + 1) / 10.0);
+}
+
+/**
+ * @brief Chooses the queue a free worker takes its next job from: smooth
+ * weighted round-robin over the queues with jobs whose class is under its
+ * worker limit. Call with the lock held.
+ * @return The class, or -1 if no job may start.
+ */
+int async_pick(sudoku_async *a) {
+  int best = -1, sum = 0;
+  for (int c = 0; c < NUM_ASYNC_CLASSES; c++) {
+    async_class *k = &a->classes[c];
+    if (k->queued == 0 || k->running >= k->policy.max_running) { continue; }
+    k->credit += k->policy.weight;
+    sum += k->policy.weight;
+    if (best < 0 || k->credit > a->classes[best].credit) { best = c; }
+  }
+  if (best >= 0) { a->classes[best].credit -= sum; }
+  return best;
+}
+
+/**
+ * @brief Returns the number of queued jobs. Call with the lock held.
+ */
+int async_queued(const sudoku_async *a) {
+  int queued = 0;
+  for (int c = 0; c < NUM_ASYNC_CLASSES; c++) {
+    queued += a->classes[c].queued;
+  }
+  return queued;
+}
+
+/**
+ * @brief Worker function: solves queued jobs until shutdown.
+ * @param arg The sudoku_async.
+ * @return NULL.
+ */
+void *async_worker(void *arg) {
+  sudoku_async *a = (sudoku_async *)arg;
+  pthread_mutex_lock(&a->lock);
+  for (;;) {
+    int q = async_pick(a);
+    if (q < 0) {
+      if (a->stopping && async_queued(a) == 0) { break; }
+      pthread_cond_wait(&a->work, &a->lock);
+      continue;
+    }
+    async_class *k = &a->classes[q];
+    async_job *job = async_pop(&k->pending);
+    k->queued--;
+    k->running++;
+    double start = now_seconds();
+    job->wait = start - job->submitted;
+    a->classes[job->cls].stats.wait[async_bucket(job->wait)]++;
+    pthread_mutex_unlock(&a->lock);
+    async_solve(job);
+    double done = now_seconds();
+    job->seconds = done - start;
+    pthread_mutex_lock(&a->lock);
+    async_stats *stats = &a->classes[job->cls].stats;
+    stats->completed++;
+    stats->total[async_bucket(done - job->submitted)]++;
+    k->running--;
+    if (a->stopping) {
+      pthread_cond_broadcast(&a->work);
+    } else if (k->queued > 0) {
+      pthread_cond_signal(&a->work);
+    }
+    pthread_mutex_unlock(&a->lock);
+    job->next = __atomic_load_n(&a->completed, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&a->completed, &job->next, job, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    async_signal(a);
+    pthread_mutex_lock(&a->lock);
+  }
+  pthread_mutex_unlock(&a->lock);
+  return NULL;
+}
+
+/**
+ * @brief Starts a solver pool. Interactive jobs get four picks for every
+ * bulk one and may use every worker; bulk jobs may use all but one (all of
+ * a single worker). Each queue holds up to ASYNC_DEFAULT_QUEUE jobs.
+ * @param num_workers Worker threads (at least 1).
+ * @return The pool, or NULL if it could not be started or no worker thread
+ * could be created. If only some were created, the pool runs on those.
+ */
+sudoku_async *sudokuAsyncCreate(int num_workers) {
+  sudoku_async *a = (sudoku_async *)calloc(1, sizeof(sudoku_async));
+  if (a == NULL) { return NULL; }
+#ifdef __linux__
+  a->notify[0] = a->notify[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  bool ok = a->notify[0] >= 0;
+#else
+  bool ok = pipe(a->notify) == 0;
+  for (int i = 0; ok && i < 2; i++) {
+    fcntl(a->notify[i], F_SETFL, fcntl(a->notify[i], F_GETFL) | O_NONBLOCK);
+  }
+#endif
+  a->workers = (pthread_t *)malloc(num_workers * sizeof(pthread_t));
+  if (!ok || a->workers == NULL) {
+    if (ok) { close(a->notify[0]); }
+    if (ok && a->notify[1] != a->notify[0]) { close(a->notify[1]); }
+    free(a->workers);
+    free(a);
+    return NULL;
+  }
+  pthread_mutex_init(&a->lock, NULL);
+  pthread_cond_init(&a->work, NULL);
+  for (a->num_workers = 0; a->num_workers < num_workers; a->num_workers++) {
+    if (pthread_create(&a->workers[a->num_workers], NULL, async_worker, a) !=
+        0) {
+      break;
+    }
+  }
+  if (a->num_workers == 0) {
+    close(a->notify[0]);
+    if (a->notify[1] != a->notify[0]) { close(a->notify[1]); }
+    pthread_cond_destroy(&a->work);
+    pthread_mutex_destroy(&a->lock);
+    free(a->workers);
+    free(a);
+    return NULL;
+  }
+  // Limits follow the workers that actually started
+  int n = a->num_workers;
+  pthread_mutex_lock(&a->lock);
+  a->classes[ASYNC_INTERACTIVE].policy =
+      (async_policy){4, n, ASYNC_DEFAULT_QUEUE};
+  a->classes[ASYNC_BULK].policy =
+      (async_policy){1, n > 1 ? n - 1 : 1, ASYNC_DEFAULT_QUEUE};
+  pthread_mutex_unlock(&a->lock);
+  return a;
+}
+
+/**
+ * @brief Changes the scheduling policy of a class.
+ * @return false if the policy is out of range (weight and max_running at
+ * least 1, max_queued at least 0).
+ */
+bool sudokuAsyncSetPolicy(sudoku_async *a, int cls,
+                          const async_policy *policy) {
+  if (cls < 0 || cls >= NUM_ASYNC_CLASSES || policy->weight < 1 ||
+      policy->max_running < 1 || policy->max_queued < 0) {
+    return false;
+  }
+  pthread_mutex_lock(&a->lock);
+  a->classes[cls].policy = *policy;
+  pthread_cond_broadcast(&a->work);
+  pthread_mutex_unlock(&a->lock);
+  return true;
+}
+
+/**
+ * @brief Queues the jobs of every class in one first-in, first-out queue
+ * under the interactive class's weight and worker limit, as a pool without
+ * priorities would; statistics stay per class. Call before submitting.
+ */
+void sudokuAsyncSetFifo(sudoku_async *a, bool fifo) {
+  pthread_mutex_lock(&a->lock);
+  a->fifo = fifo;
+  pthread_mutex_unlock(&a->lock);
+}
+
+/**
+ * @brief Returns the descriptor that becomes readable when results are
+ * ready, for the host's poll/epoll set.
+ */
+int sudokuEventFd(const sudoku_async *a) { return a->notify[0]; }
+
+/**
+ * @brief Queues a copy of a puzzle for solving; does not wait.
+ * @param engine ENGINE_FILL, ENGINE_SEARCH, ENGINE_TEMPLATE or ENGINE_AUTO.
+ * @param cls ASYNC_INTERACTIVE or ASYNC_BULK.
+ * @return The ticket its result will carry, ASYNC_REJECTED if the class's
+ * queue is full or -1 if out of memory.
+ */
+long sudokuSubmit(sudoku_async *a, int psize, int **grid, int engine,
+                  int cls) {
+  async_job *job = (async_job *)calloc(1, sizeof(async_job));
+  int **copy = job != NULL ? allocSudokuPuzzle(psize) : NULL;
+  if (copy == NULL) {
+    free(job);
+    return -1;
+  }
+  copySudokuPuzzle(psize, copy, grid);
+  job->cls = cls;
+  job->engine = engine;
+  job->psize = psize;
+  job->grid = copy;
+  pthread_mutex_lock(&a->lock);
+  async_class *k = &a->classes[a->fifo ? 0 : cls];
+  async_stats *stats = &a->classes[cls].stats;
+  if (k->queued >= a->classes[cls].policy.max_queued) {
+    stats->rejected++;
+    pthread_mutex_unlock(&a->lock);
+    deleteSudokuPuzzle(psize, copy);
+    free(job);
+    return ASYNC_REJECTED;
+  }
+  stats->accepted++;
+  job->ticket = a->next_ticket++;
+  job->submitted = now_seconds();
+  async_push(&k->pending, job);
+  k->queued++;
+  pthread_cond_signal(&a->work);
+  pthread_mutex_unlock(&a->lock);
+  return job->ticket;
+}
+
+/**
+ * @brief Moves the completion stack to the ready queue, oldest first.
+ */
+void async_take(sudoku_async *a) {
+  async_job *stack = __atomic_exchange_n(&a->completed, NULL, __ATOMIC_ACQUIRE);
+  async_queue reversed = {NULL, NULL};
+  while (stack != NULL) {
+    async_job *next = stack->next;
+    stack->next = reversed.head;
+    reversed.head = stack;
+    if (reversed.tail == NULL) { reversed.tail = stack; }
+    stack = next;
+  }
+  if (reversed.head == NULL) { return; }
+  if (a->ready.tail == NULL) {
+    a->ready = reversed;
+  } else {
+    a->ready.tail->next = reversed.head;
+    a->ready.tail = reversed.tail;
+  }
+}
+
+/**
+ * @brief Takes one finished result, without waiting. Call it from one
+ * thread at a time.
+ * @return false if no result is ready.
+ */
+bool sudokuPoll(sudoku_async *a, sudoku_result *out) {
+  if (a->ready.head == NULL) { async_take(a); }
+  if (a->ready.head == NULL) {
+    async_drain(a);
+    async_take(a);
+  }
+  async_job *job = async_pop(&a->ready);
+  if (job == NULL) { return false; }
+  *out = (sudoku_result){job->ticket, job->cls, job->engine, job->psize,
+                         job->grid, job->complete, job->valid, job->wait,
+                         job->seconds};
+  free(job);
+  return true;
+}
+
+/**
+ * @brief Copies the statistics of a class.
+ */
+void sudokuAsyncStats(sudoku_async *a, int cls, async_stats *out) {
+  pthread_mutex_lock(&a->lock);
+  *out = a->classes[cls].stats;
+  pthread_mutex_unlock(&a->lock);
+}
+
+/**
+ * @brief Stops the pool once the queued jobs are solved and frees it with
+ * any results not polled.
+ */
+void sudokuAsyncDestroy(sudoku_async *a) {
+  pthread_mutex_lock(&a->lock);
+  a->stopping = true;
+  pthread_cond_broadcast(&a->work);
+  pthread_mutex_unlock(&a->lock);
+  for (int i = 0; i < a->num_workers; i++) {
+    pthread_join(a->workers[i], NULL);
+  }
+  async_take(a);
+  for (async_job *job; (job = async_pop(&a->ready)) != NULL;) {
+    deleteSudokuPuzzle(job->psize, job->grid);
+    free(job);
+  }
+  close(a->notify[0]);
+  if (a->notify[1] != a->notify[0]) { close(a->notify[1]); }
+  pthread_cond_destroy(&a->work);
+  pthread_mutex_destroy(&a->lock);
+  free(a->workers);
+  free(a);
+}
+
+/**
+ * @brief Runs "--async [--workers N] [--engine E] [--model FILE]
+ * puzzle.txt ...": submits
+ * every puzzle, then waits on the notification descriptor with poll(2) and
+ * collects the results; prints them in submission order.
+ */
+int runAsync(int argc, char **argv) {
+  int num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int engine = ENGINE_FILL;
+  const char *model = SELECT_MODEL_DEFAULT;
+  int argi = 0;
+  bool ok = true;
+  for (; ok && argi + 1 < argc && argv[argi][0] == '-'; argi += 2) {
+    if (strcmp(argv[argi], "--workers") == 0) {
+      num_workers = atoi(argv[argi + 1]);
+      ok = num_workers >= 1;
+    } else if (strcmp(argv[argi], "--engine") == 0) {
+      for (engine = 0; engine < NUM_ENGINES; engine++) {
+        if (strcmp(argv[argi + 1], engine_names[engine]) == 0) { break; }
+      }
+      ok = engine < NUM_ENGINES;
+    } else if (strcmp(argv[argi], "--model") == 0) {
+      model = argv[argi + 1];
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok || argi >= argc) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  if (engine == ENGINE_AUTO && !loadSelectorModel(model)) {
+    printf("Could not read selector model %s\n", model);
+    return EXIT_FAILURE;
+  }
+  sudoku_async *a = sudokuAsyncCreate(num_workers);
+  if (a == NULL) {
+    printf("Could not start the solver pool\n");
+    return EXIT_FAILURE;
+  }
+  int count = argc - argi;
+  sudoku_result *results = (sudoku_result *)calloc(count, sizeof(*results));
+  for (int i = 0; i < count; i++) {
+    int **grid = NULL;
+    int psize = readSudokuPuzzle(argv[argi + i], &grid);
+    if (sudokuSubmit(a, psize, grid, engine, ASYNC_INTERACTIVE) < 0) {
+      printf("Not enough memory for a %dx%d puzzle\n", psize, psize);
+      exit(EXIT_FAILURE);
+    }
+    deleteSudokuPuzzle(psize, grid);
+  }
+  struct pollfd pfd = {sudokuEventFd(a), POLLIN, 0};
+  for (int received = 0; received < count;) {
+    poll(&pfd, 1, -1);
+    sudoku_result r;
+    while (sudokuPoll(a, &r)) {
+      results[r.ticket] = r;
+      received++;
+    }
+  }
+  sudokuAsyncDestroy(a);
+  for (int i = 0; i < count; i++) {
+    printf("%s:\n", argv[argi + i]);
+    printf("Complete puzzle? ");
+    printf(results[i].complete ? "true\n" : "false\n");
+    if (results[i].complete) {
+      printf("Valid puzzle? ");
+      printf(results[i].valid ? "true\n" : "false\n");
+    }
+    printSudokuPuzzle(results[i].psize, results[i].grid);
+    deleteSudokuPuzzle(results[i].psize, results[i].grid);
+  }
+  free(results);
+  return EXIT_SUCCESS;
+}
+
+// --- Server Mode ---
+
+/*
+ * --serve keeps a solver pool running and takes requests from stdin, one
+ * per line: a class (interactive or bulk) and a puzzle file. It answers on
+ * stdout, one line per request as results complete: the ticket, the class,
+ * the file and valid, invalid or incomplete. A request for a full class
+ * queue is answered "rejected", or with --delay held, and stdin left
+ * unread, until the queue has room, which pushes back on the producer
+ * through the pipe (and on any interactive requests behind it, so delay
+ * suits a bulk-only feed). With no job in flight nothing can make room,
+ * so the request is rejected after all. At end of input it waits for the queued jobs
+ * and, with --metrics, prints per-class counts and latency percentiles;
+ * --fifo runs the same load through a single queue for comparison.
+ */
+
+#define SERVE_LINE_MAX 4096
+
+typedef struct {
+  sudoku_async *a;
+  int engine;
+  bool delay;           // Hold requests for a full queue instead of rejecting
+  char buf[4 * SERVE_LINE_MAX];
+  size_t have;          // Bytes of buf read but not yet handled
+  bool eof;
+  bool held;            // The first line of buf waits for queue space
+  bool skipping;        // Dropping the rest of an overlong line
+  char **names;         // Puzzle file of each ticket
+  long accepted, received, capacity;
+} serve_state;
+
+/**
+ * @brief Handles one request line.
+ * @return false if it must be held for queue space.
+ */
+bool serve_request(serve_state *st, char *line) {
+  char cls_name[16];
+  int off = 0;
+  if (sscanf(line, "%15s %n", cls_name, &off) != 1) { return true; }
+  char *path = line + off;
+  size_t len = strlen(path);
+  while (len > 0 && isspace((unsigned char)path[len - 1])) { path[--len] = 0; }
+  int cls = 0;
+  while (cls < NUM_ASYNC_CLASSES && strcmp(cls_name, async_class_names[cls])) {
+    cls++;
+  }
+  if (cls == NUM_ASYNC_CLASSES || len == 0) {
+    printf("Bad request: %s\n", line);
+    return true;
+  }
+  int **grid = NULL;
+  int psize = loadSudokuPuzzle(path, &grid);
+  if (psize == 0) { return true; }
+  long ticket = sudokuSubmit(st->a, psize, grid, st->engine, cls);
+  deleteSudokuPuzzle(psize, grid);
+  // Hold only while a job is in flight whose completion frees queue space
+  if (ticket == ASYNC_REJECTED && st->delay && st->received < st->accepted) {
+    return false;
+  }
+  if (ticket == ASYNC_REJECTED) {
+    printf("- %s %s: rejected, queue full\n", cls_name, path);
+  } else if (ticket < 0) {
+    printf("- %s %s: not enough memory\n", cls_name, path);
+  } else {
+    if (ticket >= st->capacity) {
+      st->capacity = st->capacity > 0 ? 2 * st->capacity : 256;
+      st->names = (char **)realloc(st->names, st->capacity * sizeof(char *));
+    }
+    st->names[ticket] = strdup(path);
+    st->accepted++;
+  }
+  return true;
+}
+
+/**
+ * @brief Handles the complete lines read so far (and a last unterminated
+ * one at end of input), stopping at a line that must be held.
+ */
+void serve_requests(serve_state *st) {
+  size_t start = 0;
+  st->held = false;
+  if (st->skipping) {
+    char *nl = (char *)memchr(st->buf, '\n', st->have);
+    st->skipping = nl == NULL;
+    start = nl != NULL ? (size_t)(nl - st->buf) + 1 : st->have;
+  }
+  while (start < st->have) {
+    char *line = st->buf + start;
+    char *nl = (char *)memchr(line, '\n', st->have - start);
+    size_t len = nl != NULL ? (size_t)(nl - line) : st->have - start;
+    if (nl == NULL && !st->eof) {
+      if (len < SERVE_LINE_MAX) { break; }
+      printf("Bad request: longer than %d bytes\n", SERVE_LINE_MAX);
+      st->skipping = true;
+      start = st->have;
+      break;
+    }
+    char saved = line[len];
+    line[len] = 0;
+    if (!serve_request(st, line)) {
+      line[len] = saved;
+      st->held = true;
+      break;
+    }
+    start += len + (nl != NULL);
+  }
+  memmove(st->buf, st->buf + start, st->have - start);
+  st->have -= start;
+}
+
+/**
+ * @brief Runs "--serve [--workers N] [--engine E] [--model FILE]
+ * [--bulk-workers N] [--bulk-queue N] [--bulk-weight N] [--fifo] [--delay]
+ * [--metrics]".
+ */
+int runServe(int argc, char **argv) {
+  int num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int bulk_workers = 0, bulk_queue = -1, bulk_weight = 0;  // 0, -1: default
+  bool fifo = false, metrics = false;
+  const char *model = SELECT_MODEL_DEFAULT;
+  serve_state *st = (serve_state *)calloc(1, sizeof(serve_state));
+  st->engine = ENGINE_FILL;
+  bool ok = true;
+  for (int argi = 0; ok && argi < argc; argi++) {
+    bool has_value = argi + 1 < argc;
+    if (strcmp(argv[argi], "--workers") == 0 && has_value) {
+      num_workers = atoi(argv[++argi]);
+      ok = num_workers >= 1;
+    } else if (strcmp(argv[argi], "--engine") == 0 && has_value) {
+      argi++;
+      for (st->engine = 0; st->engine < NUM_ENGINES; st->engine++) {
+        if (strcmp(argv[argi], engine_names[st->engine]) == 0) { break; }
+      }
+      ok = st->engine < NUM_ENGINES;
+    } else if (strcmp(argv[argi], "--model") == 0 && has_value) {
+      model = argv[++argi];
+    } else if (strcmp(argv[argi], "--bulk-workers") == 0 && has_value) {
+      bulk_workers = atoi(argv[++argi]);
+      ok = bulk_workers >= 1;
+    } else if (strcmp(argv[argi], "--bulk-queue") == 0 && has_value) {
+      bulk_queue = atoi(argv[++argi]);
+      ok = bulk_queue >= 0;
+    } else if (strcmp(argv[argi], "--bulk-weight") == 0 && has_value) {
+      bulk_weight = atoi(argv[++argi]);
+      ok = bulk_weight >= 1;
+    } else if (strcmp(argv[argi], "--fifo") == 0) {
+      fifo = true;
+    } else if (strcmp(argv[argi], "--delay") == 0) {
+      st->delay = true;
+    } else if (strcmp(argv[argi], "--metrics") == 0) {
+      metrics = true;
+    } else {
+      ok = false;
+    }
+  }
+  if (ok && st->delay && bulk_queue == 0) {
+    printf("--delay needs a bulk queue bound of at least 1\n");
+    free(st);
+    return EXIT_FAILURE;
+  }
+  if (!ok) {
+    printUsage();
+    free(st);
+    return EXIT_FAILURE;
+  }
+  if (st->engine == ENGINE_AUTO && !loadSelectorModel(model)) {
+    printf("Could not read selector model %s\n", model);
+    free(st);
+    return EXIT_FAILURE;
+  }
+  st->a = sudokuAsyncCreate(num_workers);
+  if (st->a == NULL) {
+    printf("Could not start the solver pool\n");
+    free(st);
+    return EXIT_FAILURE;
+  }
+  async_policy bulk = st->a->classes[ASYNC_BULK].policy;
+  if (bulk_workers > 0) { bulk.max_running = bulk_workers; }
+  if (bulk_queue >= 0) { bulk.max_queued = bulk_queue; }
+  if (bulk_weight > 0) { bulk.weight = bulk_weight; }
+  sudokuAsyncSetPolicy(st->a, ASYNC_BULK, &bulk);
+  sudokuAsyncSetFifo(st->a, fifo);
+  setvbuf(stdout, NULL, _IOLBF, 0);  // Answers go out as they are ready
+  while (!st->eof || st->have > 0 || st->received < st->accepted) {
+    bool want_input = !st->eof && !st->held && st->have < sizeof(st->buf);
+    struct pollfd pfd[2] = {{sudokuEventFd(st->a), POLLIN, 0},
+                            {want_input ? STDIN_FILENO : -1, POLLIN, 0}};
+    if (poll(pfd, 2, -1) < 0 && errno != EINTR) { break; }
+    sudoku_result r;
+    while (sudokuPoll(st->a, &r)) {
+      printf("%ld %s %s: %s\n", r.ticket, async_class_names[r.cls],
+             st->names[r.ticket],
+             !r.complete ? "incomplete" : r.valid ? "valid" : "invalid");
+      deleteSudokuPuzzle(r.psize, r.grid);
+      free(st->names[r.ticket]);
+      st->received++;
+    }
+    if (pfd[1].revents != 0) {
+      ssize_t n = read(STDIN_FILENO, st->buf + st->have,
+                       sizeof(st->buf) - st->have);
+      if (n > 0) {
+        st->have += n;
+      } else if (n == 0 || errno != EINTR) {
+        st->eof = true;
+      }
+    }
+    serve_requests(st);
+    if (st->eof && !st->held) { st->have = 0; }
+  }
+  if (metrics) {
+    printf("%-11s %8s %8s %10s %10s %10s %10s\n", "class", "accepted",
+           "rejected", "wait p50", "wait p99", "total p50", "total p99");
+    for (int c = 0; c < NUM_ASYNC_CLASSES; c++) {
+      async_stats s;
+      sudokuAsyncStats(st->a, c, &s);
+      printf("%-11s %8ld %8ld %7.3f ms %7.3f ms %7.3f ms %7.3f ms\n",
+             async_class_names[c], s.accepted, s.rejected,
+             1e3 * async_percentile(s.wait, 0.5),
+             1e3 * async_percentile(s.wait, 0.99),
+             1e3 * async_percentile(s.total, 0.5),
+             1e3 * async_percentile(s.total, 0.99));
+    }
+  }
+  sudokuAsyncDestroy(st->a);
+  free(st->names);
+  free(st);
+  return EXIT_SUCCESS;
+}
+
+// expects file name of the puzzle as argument in command line
+/**
+ * @brief Main entry point of the program.
+ * @param argc The number of command-line arguments.
+ * @param argv An array of command-line arguments. Expects the puzzle filename,
+ * optionally preceded by options, or a benchmark mode (see printUsage).
+ */
+int main(int argc, char **argv) { 
+  if (argc >= 2 && strcmp(argv[1], "--bench-scaling") == 0) {
+    return runScalingBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--microbench") == 0) {
+    return runMicroBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench-hugepages") == 0) {
+    return runHugePageBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench-tokenizer") == 0) {
+    return runTokenizerBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench-startup") == 0) {
+    return runStartupBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--autotune") == 0) {
+    return runAutotune(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench-engines") == 0) {
+    return runEngineBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--train-selector") == 0) {
+    return runTrainSelector(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench-replay") == 0) {
+    return runReplayBenchmark(argc - 2, argv + 2);
+  }
+  if (argc == 2 && argv[1][0] != '-' && solveColdStart(argv[1])) {
+    return EXIT_SUCCESS;
+  }
+  if (argc >= 2 && strncmp(argv[1], "--corpus-", 9) == 0) {
+    return runCorpus(argv[1], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--audit") == 0) {
+    return runAudit(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--sample-solutions") == 0) {
+    return runSampleSolutions(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && (strcmp(argv[1], "--augment") == 0 ||
+                    strcmp(argv[1], "--boards-print") == 0)) {
+    return runAugment(argv[1], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--export-tensors") == 0) {
+    return runExportTensors(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--repair") == 0) {
+    return runRepair(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--dedup") == 0) {
+    return runDedup(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--async") == 0) {
+    return runAsync(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+    return runServe(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--trace") == 0) {
+    return runTrace(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--replay") == 0) {
+    return runReplay(argc - 2, argv + 2);
+  }
+  // Options come before the puzzle file
+  int engine = ENGINE_FILL;
+  bool show_stats = false;
+  double capture_ms = 0;  // 0: no capture
+  const char *capture_dir = "slow-puzzles";
+  const char *profile = NULL;  // NULL: built-in thread choices
+  const char *model = SELECT_MODEL_DEFAULT;
+  int argi = 1;
+  for (; argi < argc - 1; argi++) {
+    if (strcmp(argv[argi], "--engine") == 0 && argi + 1 < argc - 1) {
+      argi++;
+      for (engine = 0; engine < NUM_ENGINES; engine++) {
+        if (strcmp(argv[argi], engine_names[engine]) == 0) { break; }
+      }
+      if (engine == NUM_ENGINES) { break; }
+    } else if (strcmp(argv[argi], "--stats") == 0) {
+      show_stats = true;
+    } else if (strcmp(argv[argi], "--mem-budget") == 0 && argi + 1 < argc - 1) {
+      mem_budget = parseMemorySize(argv[++argi]);
+      if (mem_budget == 0) { break; }
+    } else if (strcmp(argv[argi], "--capture-slow") == 0 &&
+               argi + 1 < argc - 1) {
+      capture_ms = atof(argv[++argi]);
+      if (capture_ms <= 0) { break; }
+    } else if (strcmp(argv[argi], "--capture-dir") == 0 &&
+               argi + 1 < argc - 1) {
+      capture_dir = argv[++argi];
+    } else if (strcmp(argv[argi], "--profile") == 0 && argi + 1 < argc - 1) {
+      profile = argv[++argi];
+    } else if (strcmp(argv[argi], "--model") == 0 && argi + 1 < argc - 1) {
+      model = argv[++argi];
+    } else {
+      break;
+    }
+  }
+  if (argi != argc - 1) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  if (profile != NULL && !loadTuneProfile(profile)) {
+    printf("Could not read tuning profile %s\n", profile);
+    return EXIT_FAILURE;
+  }
+  if (engine == ENGINE_AUTO && !loadSelectorModel(model)) {
+    printf("Could not read selector model %s\n", model);
+    return EXIT_FAILURE;
+  }
+  // grid is a 2D array
+  int **grid = NULL;
+  // find grid size and fill grid
+  double run_start = now_seconds();
+  int sudokuSize = readSudokuPuzzle(argv[argi], &grid);
+  double t = now_seconds();
+  last_run.seconds[RUN_READ] = t - run_start;
+  bool valid = false;
+  bool complete = false;
+  search_stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  template_stats tstats = {0, 0, 0, 0, 0};
+  bool routed = engine == ENGINE_AUTO;
+  if (routed) { engine = selectEngine(sudokuSize, grid); }
+  int status = runEngine(engine, sudokuSize, grid, &stats, &tstats);
+  last_run.seconds[RUN_SOLVE] = now_seconds() - t;
+  checkPuzzle(sudokuSize, grid, &complete, &valid);
+  if (routed && engine == ENGINE_FILL && !complete) {
+    // Mispredicted: the search finishes what the fill-in loop left
+    engine = ENGINE_SEARCH;
+    status = runEngine(engine, sudokuSize, grid, &stats, &tstats);
+    checkPuzzle(sudokuSize, grid, &complete, &valid);
+  }
+  t = now_seconds();
+  printf("Complete puzzle? ");
+  printf(complete ? "true\n" : "false\n");
+  if (complete) {
+    printf("Valid puzzle? ");
+    printf(valid ? "true\n" : "false\n");
+  }
+  printSudokuPuzzle(sudokuSize, grid);
+  if (show_stats && engine == ENGINE_SEARCH) { printSearchStats(&stats); }
+  if (show_stats && engine == ENGINE_TEMPLATE && sudokuSize == 9) {
+    printTemplateStats(&tstats);
+  }
+  double end = now_seconds();
+  last_run.seconds[RUN_PRINT] = end - t;
+  if (capture_ms > 0 && (end - run_start) * 1e3 >= capture_ms &&
+      !captureSlowPuzzle(capture_dir, argv[argi], engine, end - run_start,
+                         &stats, &tstats)) {
+    printf("Could not capture the run in %s\n", capture_dir);
+  }
+  deleteSudokuPuzzle(sudokuSize, grid);
+  return status;
 }
\ No newline at end of file